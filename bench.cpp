@@ -0,0 +1,266 @@
+#include <chrono>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <unistd.h>
+
+#include "world.h"
+#include "profiler.h"
+#include "replay.h"
+
+// Steps a world without a window or GL context and reports where the time
+// went. Same seed, piece count and update count give the same simulation,
+// so runs can be compared across changes.
+
+namespace {
+// same playing field as the game window
+constexpr int WORLD_WIDTH = 224;
+constexpr int WORLD_HEIGHT = 304;
+
+constexpr unsigned DEFAULT_SEED = 1;
+constexpr int DEFAULT_PIECES = 50;
+constexpr int DEFAULT_UPDATES = 3000;
+}
+
+static int num_updates = 0;
+static world_options options;
+static const char *trace_path = nullptr;
+static const char *record_path = nullptr;
+static const char *playback_path = nullptr;
+static bool field_walls = false;
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -S seed     random seed (default %u)\n"
+		"  -p pieces   stop spawning after this many pieces, 0 for no limit (default %d)\n"
+		"  -u updates  number of updates to run (default %d)\n"
+		"  -t threads  solver threads, 0 for one per core (default 0)\n"
+		"  -b type     broad phase, brute or hash (default hash)\n"
+		"  -n          never put pieces to sleep\n"
+		"  -c          clear full rows of settled blocks, and the pile once it\n"
+		"              overflows\n"
+		"  -f          walls from a distance field of the bowl outline instead of\n"
+		"              the exact bowl\n"
+		"  -m passes   fewest solver passes per update (default %d)\n"
+		"  -i passes   most solver passes per update (default %d)\n"
+		"  -e error    stop solving once no spring or contact is off by more\n"
+		"              than this, 0 to always run every pass (default %g)\n"
+		"  -T file     write a Chrome trace of every update to file\n"
+		"  -w file     record a replay to file\n"
+		"  -l file     play back a replay from file, ignores -S, -p, -n, -c, -f, -m,\n"
+		"              -i and -e\n",
+		argv0, DEFAULT_SEED, DEFAULT_PIECES, DEFAULT_UPDATES, solver_options().min_iterations, solver_options().max_iterations, solver_options().tolerance);
+	exit(1);
+}
+
+static void
+parse_options(int argc, char *argv[])
+{
+	options.max_pieces = DEFAULT_PIECES;
+	options.seed = DEFAULT_SEED;
+
+	int opt;
+
+	while ((opt = getopt(argc, argv, "S:p:u:t:b:ncfm:i:e:T:w:l:")) != -1) {
+		switch (opt) {
+			case 'S':
+				options.seed = strtoul(optarg, nullptr, 10);
+				break;
+
+			case 'p':
+				options.max_pieces = atoi(optarg);
+				break;
+
+			case 'u':
+				num_updates = atoi(optarg);
+				break;
+
+			case 't':
+				options.num_threads = atoi(optarg);
+				break;
+
+			case 'b':
+				if (!strcmp(optarg, "brute"))
+					options.broad_phase = broad_phase_type::BRUTE_FORCE;
+				else if (!strcmp(optarg, "hash"))
+					options.broad_phase = broad_phase_type::SPATIAL_HASH;
+				else
+					usage(argv[0]);
+				break;
+
+			case 'n':
+				options.allow_sleeping = false;
+				break;
+
+			case 'c':
+				options.clear_rows = true;
+				break;
+
+			case 'f':
+				field_walls = true;
+				break;
+
+			case 'm':
+				options.solver.min_iterations = atoi(optarg);
+				break;
+
+			case 'i':
+				options.solver.max_iterations = atoi(optarg);
+				break;
+
+			case 'e':
+				options.solver.tolerance = atof(optarg);
+				break;
+
+			case 'T':
+				trace_path = optarg;
+				break;
+
+			case 'w':
+				record_path = optarg;
+				break;
+
+			case 'l':
+				playback_path = optarg;
+				break;
+
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (num_updates < 0 || options.num_threads < 0 || options.solver.min_iterations < 1 || options.solver.max_iterations < options.solver.min_iterations || options.solver.tolerance < 0)
+		usage(argv[0]);
+}
+
+// FNV-1a over the body positions a renderer would get, to check two runs
+// ended up in the same state
+
+static uint64_t
+state_hash(const world& w)
+{
+	world_snapshot s;
+	w.publish(s);
+
+	uint64_t h = 14695981039346656037ull;
+
+	for (float f : s.xy) {
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof bits);
+
+		for (int i = 0; i < 4; i++)
+			h = (h ^ ((bits >> 8*i) & 0xff))*1099511628211ull;
+	}
+
+	return h;
+}
+
+static void
+print_phase(const char *name, double ms, double total_ms, int updates)
+{
+	printf("%-12s %10.2f ms %8.4f ms/update %6.1f%%\n", name, ms, ms/updates, total_ms > 0 ? 100*ms/total_ms : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	parse_options(argc, argv);
+
+	replay_log playback;
+
+	if (playback_path) {
+		if (!playback.load(playback_path)) {
+			fprintf(stderr, "failed to load %s\n", playback_path);
+			return 1;
+		}
+
+		if (playback.get_width() != WORLD_WIDTH || playback.get_height() != WORLD_HEIGHT) {
+			fprintf(stderr, "%s was recorded on a %dx%d world\n", playback_path, playback.get_width(), playback.get_height());
+			return 1;
+		}
+
+		options.seed = playback.get_seed();
+		options.allow_sleeping = playback.get_allow_sleeping();
+		options.solver = playback.get_solver();
+		options.clear_rows = playback.get_clear_rows();
+		options.playback = &playback;
+
+		field_walls = playback.get_walls() == replay_log::walls_kind::BOWL_FIELD;
+
+		if (num_updates == 0)
+			num_updates = playback.get_num_updates();
+	}
+
+	if (num_updates == 0)
+		num_updates = DEFAULT_UPDATES;
+
+	const auto walls = field_walls ? replay_log::walls_kind::BOWL_FIELD : replay_log::walls_kind::BOWL;
+
+	replay_log record(options.seed, WORLD_WIDTH, WORLD_HEIGHT, options.allow_sleeping, options.solver, options.clear_rows, walls);
+
+	if (record_path)
+		options.record = &record;
+
+	const container field = container::make_outline(container::make_bowl(WORLD_WIDTH, WORLD_HEIGHT).get_outline());
+
+	if (field_walls)
+		options.walls = &field;
+
+	world w(WORLD_WIDTH, WORLD_HEIGHT, options);
+
+	profiler& prof = profiler::get_instance();
+
+	if (trace_path && !prof.start_trace(trace_path)) {
+		fprintf(stderr, "failed to open %s\n", trace_path);
+		return 1;
+	}
+
+	size_t counters[profiler::NUM_COUNTERS] {};
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < num_updates; i++) {
+		w.update();
+		prof.end_frame();
+
+		for (int j = 0; j < profiler::NUM_COUNTERS; j++)
+			counters[j] += prof.get_frame(0).counters[j];
+	}
+
+	const double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	const world_timings& t = w.get_timings();
+
+	printf("seed %u, %zu pieces, %d updates, state %016llx\n", options.seed, w.get_num_pieces(), t.updates, static_cast<unsigned long long>(state_hash(w)));
+
+	print_phase("integrate", t.integrate, total_ms, t.updates);
+	print_phase("broad phase", t.broad_phase, total_ms, t.updates);
+	print_phase("solve", t.solve, total_ms, t.updates);
+	print_phase("  springs", t.springs, total_ms, t.updates);
+	print_phase("  walls", t.walls, total_ms, t.updates);
+	print_phase("  collide", t.collide, total_ms, t.updates);
+	print_phase("total", total_ms, total_ms, t.updates);
+
+	for (int i = 0; i < profiler::NUM_COUNTERS; i++)
+		printf("%-12s %10zu %8.1f /update\n", get_counter_name(static_cast<profile_counter>(i)), counters[i], static_cast<double>(counters[i])/t.updates);
+
+	prof.stop_trace();
+
+	if (record_path) {
+		record.set_num_updates(w.get_num_updates());
+
+		if (!record.save(record_path)) {
+			fprintf(stderr, "failed to write %s\n", record_path);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,236 @@
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <unordered_map>
+
+#include "broad_phase.h"
+
+//
+//  b r o a d _ p h a s e
+//
+
+aabb
+broad_phase::fatten(const aabb& box) const
+{
+	return { box.min - vec2(margin_, margin_), box.max + vec2(margin_, margin_) };
+}
+
+void
+broad_phase::add_proxy(size_t id, const aabb& box)
+{
+	if (id == proxies_.size()) {
+		proxies_.emplace_back();
+		active_.push_back(false);
+	}
+
+	assert(id < proxies_.size() && !active_[id]);
+
+	proxies_[id] = fatten(box);
+	active_[id] = true;
+	update_cells(id);
+}
+
+void
+broad_phase::remove_proxy(size_t id)
+{
+	assert(active_[id]);
+
+	remove_cells(id);
+	active_[id] = false;
+}
+
+bool
+broad_phase::move_proxy(size_t id, const aabb& box)
+{
+	if (proxies_[id].contains(box))
+		return false;
+
+	proxies_[id] = fatten(box);
+	update_cells(id);
+
+	return true;
+}
+
+namespace {
+
+//
+//  b r u t e _ f o r c e _ b r o a d _ p h a s e
+//
+
+class brute_force_broad_phase : public broad_phase
+{
+public:
+	brute_force_broad_phase(float margin)
+	: broad_phase(margin)
+	{ }
+
+	void find_pairs(std::vector<proxy_pair>& pairs) const override;
+
+private:
+	void update_cells(size_t) override
+	{ }
+
+	void remove_cells(size_t) override
+	{ }
+};
+
+void
+brute_force_broad_phase::find_pairs(std::vector<proxy_pair>& pairs) const
+{
+	pairs.clear();
+
+	for (size_t i = 0; i + 1 < proxies_.size(); i++) {
+		if (!active_[i])
+			continue;
+
+		for (size_t j = i + 1; j < proxies_.size(); j++) {
+			if (active_[j] && proxies_[i].overlaps(proxies_[j]))
+				pairs.push_back(std::make_pair(i, j));
+		}
+	}
+}
+
+//
+//  s p a t i a l _ h a s h _ b r o a d _ p h a s e
+//
+
+class spatial_hash_broad_phase : public broad_phase
+{
+public:
+	spatial_hash_broad_phase(float margin, float cell_size)
+	: broad_phase(margin)
+	, cell_size_(cell_size)
+	{ }
+
+	void find_pairs(std::vector<proxy_pair>& pairs) const override;
+
+private:
+	struct cell_range
+	{
+		int x0, y0, x1, y1;
+	};
+
+	static uint64_t cell_key(int x, int y)
+	{ return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y); }
+
+	cell_range get_cell_range(const aabb& box) const;
+
+	void update_cells(size_t id) override;
+	void remove_cells(size_t id) override;
+
+	float cell_size_;
+	std::vector<cell_range> ranges_; // empty for removed proxies
+	std::unordered_map<uint64_t, std::vector<size_t>> cells_;
+};
+
+spatial_hash_broad_phase::cell_range
+spatial_hash_broad_phase::get_cell_range(const aabb& box) const
+{
+	return {
+		static_cast<int>(floorf(box.min.x/cell_size_)),
+		static_cast<int>(floorf(box.min.y/cell_size_)),
+		static_cast<int>(floorf(box.max.x/cell_size_)),
+		static_cast<int>(floorf(box.max.y/cell_size_)) };
+}
+
+void
+spatial_hash_broad_phase::update_cells(size_t id)
+{
+	const cell_range r = get_cell_range(proxies_[id]);
+
+	if (id < ranges_.size()) {
+		const cell_range& prev = ranges_[id];
+
+		// still in the same cells, nothing to do
+
+		if (prev.x0 == r.x0 && prev.y0 == r.y0 && prev.x1 == r.x1 && prev.y1 == r.y1)
+			return;
+
+		remove_cells(id);
+
+		ranges_[id] = r;
+	} else {
+		assert(id == ranges_.size());
+		ranges_.push_back(r);
+	}
+
+	for (int y = r.y0; y <= r.y1; y++) {
+		for (int x = r.x0; x <= r.x1; x++)
+			cells_[cell_key(x, y)].push_back(id);
+	}
+}
+
+void
+spatial_hash_broad_phase::remove_cells(size_t id)
+{
+	cell_range& r = ranges_[id];
+
+	for (int y = r.y0; y <= r.y1; y++) {
+		for (int x = r.x0; x <= r.x1; x++) {
+			auto cell = cells_.find(cell_key(x, y));
+			assert(cell != cells_.end());
+
+			auto& ids = cell->second;
+			auto it = std::find(ids.begin(), ids.end(), id);
+			assert(it != ids.end());
+			*it = ids.back();
+			ids.pop_back();
+
+			if (ids.empty())
+				cells_.erase(cell);
+		}
+	}
+
+	r = { 0, 0, -1, -1 };
+}
+
+void
+spatial_hash_broad_phase::find_pairs(std::vector<proxy_pair>& pairs) const
+{
+	pairs.clear();
+
+	for (auto& i : cells_) {
+		const std::vector<size_t>& cell = i.second;
+
+		const int x = static_cast<int32_t>(i.first >> 32);
+		const int y = static_cast<int32_t>(i.first & 0xffffffff);
+
+		for (size_t j = 0; j + 1 < cell.size(); j++) {
+			for (size_t k = j + 1; k < cell.size(); k++) {
+				const size_t a = cell[j];
+				const size_t b = cell[k];
+
+				if (!proxies_[a].overlaps(proxies_[b]))
+					continue;
+
+				// only report the pair from the first cell that both proxies share
+
+				const cell_range& ra = ranges_[a];
+				const cell_range& rb = ranges_[b];
+
+				if (x != std::max(ra.x0, rb.x0) || y != std::max(ra.y0, rb.y0))
+					continue;
+
+				pairs.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+			}
+		}
+	}
+
+	std::sort(pairs.begin(), pairs.end());
+}
+
+}
+
+std::unique_ptr<broad_phase>
+make_broad_phase(broad_phase_type type, float margin, float cell_size)
+{
+	switch (type) {
+		case broad_phase_type::BRUTE_FORCE:
+			return std::unique_ptr<broad_phase>(new brute_force_broad_phase(margin));
+
+		case broad_phase_type::SPATIAL_HASH:
+		default:
+			return std::unique_ptr<broad_phase>(new spatial_hash_broad_phase(margin, cell_size));
+	}
+}
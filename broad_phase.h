@@ -0,0 +1,77 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include <cstdint>
+
+#include "vec2.h"
+
+struct aabb
+{
+	bool overlaps(const aabb& other) const
+	{
+		return !(max.x < other.min.x || other.max.x < min.x ||
+		  max.y < other.min.y || other.max.y < min.y);
+	}
+
+	bool contains(const aabb& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y &&
+		  other.max.x <= max.x && other.max.y <= max.y;
+	}
+
+	vec2 min, max;
+};
+
+enum class broad_phase_type { BRUTE_FORCE, SPATIAL_HASH };
+
+using proxy_pair = std::pair<size_t, size_t>;
+
+// Keeps a fattened box for each proxy; a proxy is only re-inserted when its
+// tight box escapes the fat one, so find_pairs() may report pairs that are
+// close but not touching. Pairs are sorted and have first < second.
+//
+// Proxy ids are picked by the caller, so they can follow slots that get
+// reused: a new id is either one past the last or one that was removed.
+
+class broad_phase
+{
+public:
+	broad_phase(float margin)
+	: margin_(margin)
+	{ }
+
+	virtual ~broad_phase() = default;
+
+	void add_proxy(size_t id, const aabb& box);
+	void remove_proxy(size_t id);
+	bool move_proxy(size_t id, const aabb& box);
+
+	virtual void find_pairs(std::vector<proxy_pair>& pairs) const = 0;
+
+	const aabb& get_fat_box(size_t id) const
+	{ return proxies_[id]; }
+
+	size_t get_num_proxies() const
+	{ return proxies_.size(); }
+
+protected:
+	// called after proxies_[id] was added or changed
+	virtual void update_cells(size_t id) = 0;
+
+	// called before proxies_[id] is removed
+	virtual void remove_cells(size_t id) = 0;
+
+	std::vector<aabb> proxies_;
+	std::vector<uint8_t> active_; // parallel to proxies_
+
+private:
+	aabb fatten(const aabb& box) const;
+
+	float margin_;
+};
+
+std::unique_ptr<broad_phase>
+make_broad_phase(broad_phase_type type, float margin, float cell_size);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <GL/glew.h>
+
+namespace gge {
+
+// A texture reading its texels straight out of a buffer object, for
+// shaders to fetch from by index. Needs GL 3.1, see is_supported().
+
+class buffer_texture
+{
+public:
+	buffer_texture()
+	{ glGenTextures(1, &id_); }
+
+	~buffer_texture()
+	{ glDeleteTextures(1, &id_); }
+
+	static bool is_supported()
+	{ return GLEW_VERSION_3_1; }
+
+	// texels at or past this many can't be read
+
+	static GLint get_max_texels()
+	{
+		GLint size;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &size);
+		return size;
+	}
+
+	// texels come from buffer as format, e.g. GL_RG32F; storage the buffer
+	// gets later is picked up without attaching it again
+
+	void attach(GLuint buffer, GLenum format) const
+	{
+		// a name from glGenBuffers is only a buffer once it's been bound
+
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glBindTexture(GL_TEXTURE_BUFFER, id_);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// to texture unit, leaving unit 0 active
+
+	void bind(int unit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, id_);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+private:
+	buffer_texture(const buffer_texture&) = delete;
+	buffer_texture& operator=(const buffer_texture&) = delete;
+
+	GLuint id_;
+};
+
+}
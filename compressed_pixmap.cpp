@@ -0,0 +1,425 @@
+#include <cstdio>
+#include <climits>
+
+#include "compressed_pixmap.h"
+
+namespace gge {
+
+namespace {
+
+//
+//  d x t 1
+//
+
+uint16_t
+pack_565(int r, int g, int b)
+{
+	return ((r*31 + 127)/255) << 11 | ((g*63 + 127)/255) << 5 | ((b*31 + 127)/255);
+}
+
+void
+unpack_565(uint16_t c, int *rgb)
+{
+	const int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+int
+distance_squared(const uint8_t *a, const int *b)
+{
+	int d = 0;
+
+	for (int i = 0; i < 3; i++)
+		d += (a[i] - b[i])*(a[i] - b[i]);
+
+	return d;
+}
+
+// endpoints from the bounding box of the block, pulled in a little so the
+// extremes land between palette entries rather than on them
+
+void
+encode_dxt1(const detail::rgb_block& pixels, uint8_t *out)
+{
+	int lo[3] { 255, 255, 255 }, hi[3] { 0, 0, 0 };
+
+	for (auto& p : pixels) {
+		for (int i = 0; i < 3; i++) {
+			lo[i] = std::min<int>(lo[i], p[i]);
+			hi[i] = std::max<int>(hi[i], p[i]);
+		}
+	}
+
+	for (int i = 0; i < 3; i++) {
+		const int inset = (hi[i] - lo[i])/16;
+		lo[i] += inset;
+		hi[i] -= inset;
+	}
+
+	uint16_t c0 = pack_565(hi[0], hi[1], hi[2]);
+	uint16_t c1 = pack_565(lo[0], lo[1], lo[2]);
+
+	uint32_t indices = 0;
+
+	// c0 > c1 selects the four color mode
+
+	if (c0 == c1) {
+		// flat block, every index 0
+	} else {
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		int palette[4][3];
+
+		unpack_565(c0, palette[0]);
+		unpack_565(c1, palette[1]);
+
+		for (int i = 0; i < 3; i++) {
+			palette[2][i] = (2*palette[0][i] + palette[1][i])/3;
+			palette[3][i] = (palette[0][i] + 2*palette[1][i])/3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0, best_distance = INT_MAX;
+
+			for (int j = 0; j < 4; j++) {
+				const int d = distance_squared(pixels[i], palette[j]);
+
+				if (d < best_distance) {
+					best = j;
+					best_distance = d;
+				}
+			}
+
+			indices |= best << 2*i;
+		}
+	}
+
+	out[0] = c0; out[1] = c0 >> 8;
+	out[2] = c1; out[3] = c1 >> 8;
+
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = indices >> 8*i;
+}
+
+//
+//  e t c
+//
+
+// Only the ETC1 modes, which every ETC2 decoder reads the same way. A block
+// is split in two halves, side by side or stacked; each half has a base
+// color and a table of offsets added to all three channels, which suits
+// gray pieces well.
+
+const int ETC_MODIFIERS[8][4] {
+	{ 2, 8, -2, -8 },
+	{ 5, 17, -5, -17 },
+	{ 9, 29, -9, -29 },
+	{ 13, 42, -13, -42 },
+	{ 18, 60, -18, -60 },
+	{ 24, 80, -24, -80 },
+	{ 33, 106, -33, -106 },
+	{ 47, 183, -47, -183 } };
+
+struct etc_half
+{
+	int base[3]; // expanded to 8 bits
+	int table;
+	int indices[8];
+	int error;
+};
+
+int
+clamp_255(int v)
+{
+	return std::min(std::max(v, 0), 255);
+}
+
+// picks the table and per pixel offsets for a half with the given base color
+
+void
+fit_etc_half(const uint8_t *const *pixels, etc_half& half)
+{
+	half.error = INT_MAX;
+
+	for (int t = 0; t < 8; t++) {
+		int error = 0;
+		int indices[8];
+
+		for (int i = 0; i < 8; i++) {
+			int best = 0, best_distance = INT_MAX;
+
+			for (int j = 0; j < 4; j++) {
+				const int modified[3] {
+					clamp_255(half.base[0] + ETC_MODIFIERS[t][j]),
+					clamp_255(half.base[1] + ETC_MODIFIERS[t][j]),
+					clamp_255(half.base[2] + ETC_MODIFIERS[t][j]) };
+
+				const int d = distance_squared(pixels[i], modified);
+
+				if (d < best_distance) {
+					best = j;
+					best_distance = d;
+				}
+			}
+
+			indices[i] = best;
+			error += best_distance;
+		}
+
+		if (error < half.error) {
+			half.error = error;
+			half.table = t;
+			std::copy(indices, indices + 8, half.indices);
+		}
+	}
+}
+
+// pixel i of half h, in the encoder's own order
+
+int
+get_etc_pixel(bool flip, int h, int i)
+{
+	// stacked halves are 4 wide and 2 high, side by side ones 2 wide and 4 high
+
+	const int x = flip ? i%4 : 2*h + i%2;
+	const int y = flip ? 2*h + i/4 : i/2;
+
+	return 4*y + x;
+}
+
+void
+encode_etc(const detail::rgb_block& pixels, uint8_t *out)
+{
+	uint64_t best_bits = 0;
+	int best_error = INT_MAX;
+
+	for (int flip = 0; flip < 2; flip++) {
+		const uint8_t *half_pixels[2][8];
+		int average[2][3] {};
+
+		for (int h = 0; h < 2; h++) {
+			for (int i = 0; i < 8; i++) {
+				const uint8_t *p = pixels[get_etc_pixel(flip, h, i)];
+
+				half_pixels[h][i] = p;
+
+				for (int c = 0; c < 3; c++)
+					average[h][c] += p[c];
+			}
+		}
+
+		// differential mode if the halves are close enough, 5 bits of base
+		// color each; otherwise individual mode with 4 bits each
+
+		int q5[2][3];
+		bool differential = true;
+
+		for (int h = 0; h < 2; h++) {
+			for (int c = 0; c < 3; c++)
+				q5[h][c] = (average[h][c]*31 + 8*255/2)/(8*255);
+		}
+
+		for (int c = 0; c < 3; c++) {
+			const int delta = q5[1][c] - q5[0][c];
+
+			if (delta < -4 || delta > 3)
+				differential = false;
+		}
+
+		etc_half halves[2];
+		int q[2][3];
+
+		for (int h = 0; h < 2; h++) {
+			for (int c = 0; c < 3; c++) {
+				if (differential) {
+					q[h][c] = q5[h][c];
+					halves[h].base[c] = (q[h][c] << 3) | (q[h][c] >> 2);
+				} else {
+					q[h][c] = (average[h][c]*15 + 8*255/2)/(8*255);
+					halves[h].base[c] = (q[h][c] << 4) | q[h][c];
+				}
+			}
+
+			fit_etc_half(half_pixels[h], halves[h]);
+		}
+
+		const int error = halves[0].error + halves[1].error;
+
+		if (error >= best_error)
+			continue;
+
+		uint64_t bits = 0;
+
+		if (differential) {
+			for (int c = 0; c < 3; c++) {
+				bits |= static_cast<uint64_t>(q[0][c]) << (59 - 8*c);
+				bits |= static_cast<uint64_t>((q[1][c] - q[0][c]) & 7) << (56 - 8*c);
+			}
+
+			bits |= 1ull << 33;
+		} else {
+			for (int c = 0; c < 3; c++) {
+				bits |= static_cast<uint64_t>(q[0][c]) << (60 - 8*c);
+				bits |= static_cast<uint64_t>(q[1][c]) << (56 - 8*c);
+			}
+		}
+
+		bits |= static_cast<uint64_t>(halves[0].table) << 37;
+		bits |= static_cast<uint64_t>(halves[1].table) << 34;
+		bits |= static_cast<uint64_t>(flip) << 32;
+
+		// pixel indices go column by column; the low bit is offset
+		// magnitude, the high bit its sign
+
+		for (int h = 0; h < 2; h++) {
+			for (int i = 0; i < 8; i++) {
+				const int p = get_etc_pixel(flip, h, i);
+				const int column_order = 4*(p%4) + p/4;
+				const int index = halves[h].indices[i];
+
+				bits |= static_cast<uint64_t>(index & 1) << column_order;
+				bits |= static_cast<uint64_t>(index >> 1) << (16 + column_order);
+			}
+		}
+
+		best_bits = bits;
+		best_error = error;
+	}
+
+	// big endian
+
+	for (int i = 0; i < 8; i++)
+		out[i] = best_bits >> (56 - 8*i);
+}
+
+//
+//  a s t c
+//
+
+const uint8_t ASTC_MAGIC[4] { 0x13, 0xab, 0xa1, 0x5c };
+
+}
+
+size_t
+get_block_width(compressed_format format)
+{
+	switch (format) {
+		case compressed_format::ASTC_6x6:
+			return 6;
+
+		case compressed_format::ASTC_8x8:
+			return 8;
+
+		default:
+			return 4;
+	}
+}
+
+size_t
+get_block_height(compressed_format format)
+{
+	return get_block_width(format);
+}
+
+size_t
+get_block_bytes(compressed_format format)
+{
+	switch (format) {
+		case compressed_format::DXT1:
+		case compressed_format::ETC2_RGB8:
+			return 8;
+
+		default:
+			return 16;
+	}
+}
+
+bool
+can_encode(compressed_format format)
+{
+	return format == compressed_format::DXT1 || format == compressed_format::ETC2_RGB8;
+}
+
+namespace detail {
+
+void
+encode_block(compressed_format format, const rgb_block& pixels, uint8_t *out)
+{
+	switch (format) {
+		case compressed_format::DXT1:
+			encode_dxt1(pixels, out);
+			break;
+
+		case compressed_format::ETC2_RGB8:
+			encode_etc(pixels, out);
+			break;
+
+		default:
+			break;
+	}
+}
+
+} // detail
+
+bool
+load_astc(const char *path, compressed_pixmap& pm)
+{
+	FILE *in = fopen(path, "rb");
+
+	if (!in)
+		return false;
+
+	// magic, block dimensions, then 24 bit little endian image dimensions
+
+	uint8_t header[16];
+
+	if (fread(header, sizeof header, 1, in) != 1 || !std::equal(ASTC_MAGIC, ASTC_MAGIC + 4, header)) {
+		fclose(in);
+		return false;
+	}
+
+	const int block_width = header[4];
+	const int block_height = header[5];
+	const int block_depth = header[6];
+
+	auto get_size = [&] (int offset) {
+		return header[offset] | header[offset + 1] << 8 | header[offset + 2] << 16;
+	};
+
+	const size_t width = get_size(7);
+	const size_t height = get_size(10);
+	const size_t depth = get_size(13);
+
+	compressed_format format;
+
+	if (block_width != block_height || block_depth != 1 || depth != 1) {
+		fclose(in);
+		return false;
+	} else if (block_width == 4) {
+		format = compressed_format::ASTC_4x4;
+	} else if (block_width == 6) {
+		format = compressed_format::ASTC_6x6;
+	} else if (block_width == 8) {
+		format = compressed_format::ASTC_8x8;
+	} else {
+		fclose(in);
+		return false;
+	}
+
+	compressed_pixmap result(format, width, height);
+
+	const bool ok = fread(&result.data[0], 1, result.data.size(), in) == result.data.size();
+
+	fclose(in);
+
+	if (ok)
+		pm = std::move(result);
+
+	return ok;
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <vector>
+#include <algorithm>
+
+#include "pixmap.h"
+
+namespace gge {
+
+// Block compressed formats, all opaque RGB or RGBA. DXT1 and ETC2 can be
+// encoded from a pixmap at startup; ASTC is only loaded from files
+// compressed offline (see load_astc).
+
+enum class compressed_format { DXT1, ETC2_RGB8, ASTC_4x4, ASTC_6x6, ASTC_8x8 };
+
+size_t
+get_block_width(compressed_format format);
+
+size_t
+get_block_height(compressed_format format);
+
+// every format here takes 16 bytes per block except DXT1 and ETC2 with 8
+
+size_t
+get_block_bytes(compressed_format format);
+
+bool
+can_encode(compressed_format format);
+
+struct compressed_pixmap
+{
+	compressed_pixmap(compressed_format format, size_t width, size_t height)
+	: format(format)
+	, width(width)
+	, height(height)
+	, data(get_blocks_wide()*get_blocks_high()*get_block_bytes(format))
+	{ }
+
+	size_t get_blocks_wide() const
+	{ return (width + get_block_width(format) - 1)/get_block_width(format); }
+
+	size_t get_blocks_high() const
+	{ return (height + get_block_height(format) - 1)/get_block_height(format); }
+
+	compressed_format format;
+	size_t width;
+	size_t height;
+	std::vector<uint8_t> data;
+};
+
+namespace detail {
+
+// a 4x4 block of RGB pixels in row order
+
+using rgb_block = uint8_t[16][3];
+
+void
+encode_block(compressed_format format, const rgb_block& pixels, uint8_t *out);
+
+template <pixel_type PixelType>
+inline void
+get_rgb(const uint8_t *p, uint8_t *rgb);
+
+template <>
+inline void
+get_rgb<pixel_type::GRAY>(const uint8_t *p, uint8_t *rgb)
+{ rgb[0] = rgb[1] = rgb[2] = p[0]; }
+
+template <>
+inline void
+get_rgb<pixel_type::GRAY_ALPHA>(const uint8_t *p, uint8_t *rgb)
+{ rgb[0] = rgb[1] = rgb[2] = p[0]; }
+
+template <>
+inline void
+get_rgb<pixel_type::RGB>(const uint8_t *p, uint8_t *rgb)
+{ rgb[0] = p[0]; rgb[1] = p[1]; rgb[2] = p[2]; }
+
+template <>
+inline void
+get_rgb<pixel_type::RGB_ALPHA>(const uint8_t *p, uint8_t *rgb)
+{ rgb[0] = p[0]; rgb[1] = p[1]; rgb[2] = p[2]; }
+
+} // detail
+
+// Encodes pm into format, which must satisfy can_encode(). Alpha is
+// dropped; edge blocks repeat the last row and column.
+
+template <pixel_type PixelType>
+compressed_pixmap
+compress(const pixmap<PixelType>& pm, compressed_format format)
+{
+	compressed_pixmap cpm(format, pm.width, pm.height);
+
+	uint8_t *out = &cpm.data[0];
+
+	for (size_t by = 0; by < cpm.get_blocks_high(); by++) {
+		for (size_t bx = 0; bx < cpm.get_blocks_wide(); bx++) {
+			detail::rgb_block pixels;
+
+			for (size_t i = 0; i < 4; i++) {
+				const size_t y = std::min(4*by + i, pm.height - 1);
+
+				for (size_t j = 0; j < 4; j++) {
+					const size_t x = std::min(4*bx + j, pm.width - 1);
+					detail::get_rgb<PixelType>(&pm.data[(y*pm.width + x)*pm.pixel_size], pixels[4*i + j]);
+				}
+			}
+
+			detail::encode_block(format, pixels, out);
+			out += get_block_bytes(format);
+		}
+	}
+
+	return cpm;
+}
+
+// reads a .astc file as written by astcenc; false if it can't be read or
+// its block size isn't one of ours
+
+bool
+load_astc(const char *path, compressed_pixmap& pm);
+
+}
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <utility>
+
+#include <cassert>
+#include <cmath>
+
+#include "kernels.h"
+#include "container.h"
+
+namespace {
+constexpr auto BOWL_SEGMENTS = 20;
+
+constexpr auto FIELD_CELL_SIZE = 2.f;
+
+// how far past the outline the field goes; bodies farther out than this
+// are only ever pushed roughly back
+constexpr auto FIELD_MARGIN = 32.f;
+
+float
+get_segment_distance(const vec2& p, const vec2& a, const vec2& b)
+{
+	const vec2 ab = b - a;
+	const float t = std::min(std::max((p - a).dot(ab)/ab.length_squared(), 0.f), 1.f);
+
+	return p.distance(a + ab*t);
+}
+}
+
+container::container(std::vector<vec2> outline, bool is_bowl)
+: outline_(std::move(outline))
+, is_bowl_(is_bowl)
+, field_cols_(0)
+, field_rows_(0)
+{
+	assert(outline_.size() >= 2);
+	assert(outline_.front().y == outline_.back().y);
+
+	if (!is_bowl_)
+		build_field();
+}
+
+container
+container::make_bowl(float width, float height)
+{
+	std::vector<vec2> outline;
+
+	outline.push_back({ 0, height });
+
+	const float radius = .5*width;
+
+	float a = 0;
+	const float da = M_PI/(BOWL_SEGMENTS - 1);
+
+	for (int i = 0; i < BOWL_SEGMENTS; i++) {
+		float x = radius*(1 - cosf(a));
+		float y = radius*(1 - sinf(a));
+
+		outline.push_back({ x, y });
+		a += da;
+	}
+
+	outline.push_back({ width, height });
+
+	return container(std::move(outline), true);
+}
+
+container
+container::make_outline(std::vector<vec2> outline)
+{
+	return container(std::move(outline), false);
+}
+
+float
+container::get_distance(const vec2& p) const
+{
+	if (is_bowl_) {
+		const float width = get_right();
+		const float radius = .5f*width;
+
+		if (p.y > radius)
+			return std::max(-p.x, p.x - width);
+
+		return p.distance(vec2(radius, radius)) - radius;
+	}
+
+	float gx, gy;
+	return kernels::sample_field(get_field(), p.x, p.y, gx, gy);
+}
+
+void
+container::constrain(float *x, float *y, size_t count, float friction) const
+{
+	if (is_bowl_)
+		kernels::constrain_to_bowl(x, y, count, get_right(), friction);
+	else
+		kernels::constrain_to_field(x, y, count, get_field(), friction);
+}
+
+void
+container::build_field()
+{
+	vec2 lo = outline_.front();
+	float right = lo.x;
+
+	for (auto& i : outline_) {
+		lo.x = std::min(lo.x, i.x);
+		lo.y = std::min(lo.y, i.y);
+		right = std::max(right, i.x);
+	}
+
+	const float top = get_top();
+
+	field_cols_ = ceilf((right - lo.x + 2*FIELD_MARGIN)/FIELD_CELL_SIZE) + 1;
+	field_rows_ = ceilf((top - lo.y + FIELD_MARGIN)/FIELD_CELL_SIZE) + 1;
+
+	field_origin_ = vec2(lo.x - FIELD_MARGIN, top - (field_rows_ - 1)*FIELD_CELL_SIZE);
+
+	field_.resize(field_cols_*field_rows_);
+
+	for (int i = 0; i < field_rows_; i++) {
+		for (int j = 0; j < field_cols_; j++)
+			field_[i*field_cols_ + j] = get_outline_distance(field_origin_ + vec2(j, i)*FIELD_CELL_SIZE);
+	}
+}
+
+float
+container::get_outline_distance(const vec2& p) const
+{
+	// the top is open, so it doesn't count for distances, but it closes
+	// the outline for the inside test, done a little below it so the top
+	// row comes out inside
+
+	float distance = INFINITY;
+
+	for (size_t i = 0; i + 1 < outline_.size(); i++)
+		distance = std::min(distance, get_segment_distance(p, outline_[i], outline_[i + 1]));
+
+	const float y = std::min(p.y, get_top() - .5f*FIELD_CELL_SIZE);
+
+	bool inside = false;
+
+	for (size_t i = 0, j = outline_.size() - 1; i < outline_.size(); j = i++) {
+		const vec2& a = outline_[i];
+		const vec2& b = outline_[j];
+
+		if ((a.y > y) != (b.y > y) && p.x < a.x + (y - a.y)*(b.x - a.x)/(b.y - a.y))
+			inside = !inside;
+	}
+
+	return inside ? -distance : distance;
+}
+
+kernels::distance_field
+container::get_field() const
+{
+	return { &field_[0], field_cols_, field_rows_, field_origin_.x, field_origin_.y, FIELD_CELL_SIZE };
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+
+#include "vec2.h"
+
+namespace kernels {
+struct distance_field;
+}
+
+// The walls around the play area, shared by the solver and the renderer.
+// The outline runs from the top left corner down and around to the top
+// right corner; above its ends the walls go straight up, so the top is
+// open.
+//
+// The bowl is kept analytic, through kernels::constrain_to_bowl. Any other
+// outline is turned into a grid of signed distances, sampled with bilinear
+// filtering through kernels::constrain_to_field.
+
+class container
+{
+public:
+	// straight walls at x = 0 and x = width closed by a half circle at the
+	// bottom, the ends at y = height
+
+	static container make_bowl(float width, float height);
+
+	// outline must be at least two points, with both ends at the same height
+	// and at least one point below them
+
+	static container make_outline(std::vector<vec2> outline);
+
+	// a line loop through the outline, closed across the top
+
+	const std::vector<vec2>& get_outline() const
+	{ return outline_; }
+
+	float get_left() const
+	{ return outline_.front().x; }
+
+	float get_right() const
+	{ return outline_.back().x; }
+
+	float get_top() const
+	{ return outline_.front().y; }
+
+	// negative inside, positive outside
+
+	float get_distance(const vec2& p) const;
+
+	// moves every body outside friction of the way back in
+
+	void constrain(float *x, float *y, size_t count, float friction) const;
+
+private:
+	container(std::vector<vec2> outline, bool is_bowl);
+
+	void build_field();
+	float get_outline_distance(const vec2& p) const;
+
+	kernels::distance_field get_field() const;
+
+	std::vector<vec2> outline_;
+	bool is_bowl_;
+
+	// signed distances at the corners of cells with sides FIELD_CELL_SIZE,
+	// rows bottom up; the top row is at get_top()
+	vec2 field_origin_;
+	int field_cols_, field_rows_;
+	std::vector<float> field_;
+};
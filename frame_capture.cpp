@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <utility>
+
+#include "panic.h"
+#include "frame_capture.h"
+
+constexpr int frame_capture::NUM_PBOS;
+constexpr size_t frame_capture::MAX_QUEUED_FRAMES;
+
+frame_capture::frame_capture(int width, int height, int fps, const char *path)
+: width_(width)
+, height_(height)
+, is_pipe_(path[0] == '|')
+, use_pbos_(GLEW_ARB_pixel_buffer_object)
+, num_frames_(0)
+, quit_(false)
+, yuv_(width*height + 2*(width/2)*(height/2))
+{
+	if (width%2 || height%2)
+		panic("frame_capture: %dx%d isn't a multiple of 2", width, height);
+
+	out_ = is_pipe_ ? popen(path + 1, "w") : fopen(path, "wb");
+
+	if (!out_)
+		panic("frame_capture: failed to open %s", path);
+
+	fprintf(out_, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width_, height_, fps);
+
+	if (use_pbos_) {
+		glGenBuffers(NUM_PBOS, pbos_);
+
+		for (auto i : pbos_) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, i);
+			glBufferData(GL_PIXEL_PACK_BUFFER, width_*height_*4, nullptr, GL_STREAM_READ);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	writer_ = std::thread(&frame_capture::writer_loop, this);
+}
+
+frame_capture::~frame_capture()
+{
+	if (use_pbos_) {
+		for (int i = std::max(0, num_frames_ - NUM_PBOS); i < num_frames_; i++)
+			read_back(pbos_[i%NUM_PBOS]);
+
+		glDeleteBuffers(NUM_PBOS, pbos_);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+
+	queued_cv_.notify_one();
+	writer_.join();
+
+	if (is_pipe_)
+		pclose(out_);
+	else
+		fclose(out_);
+}
+
+void
+frame_capture::capture()
+{
+	if (!use_pbos_) {
+		// no pixel buffer objects, read back synchronously but still keep
+		// the writing off this thread
+
+		frame f = get_free_frame();
+		glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, &f[0]);
+		queue_frame(std::move(f));
+		return;
+	}
+
+	const GLuint pbo = pbos_[num_frames_%NUM_PBOS];
+
+	if (num_frames_ >= NUM_PBOS)
+		read_back(pbo);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	++num_frames_;
+}
+
+void
+frame_capture::read_back(GLuint pbo)
+{
+	frame f = get_free_frame();
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+
+	if (const void *pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY)) {
+		std::copy_n(static_cast<const uint8_t *>(pixels), f.size(), f.begin());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	queue_frame(std::move(f));
+}
+
+frame_capture::frame
+frame_capture::get_free_frame()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (free_frames_.empty())
+		return frame(width_*height_*4);
+
+	frame f = std::move(free_frames_.back());
+	free_frames_.pop_back();
+	return f;
+}
+
+void
+frame_capture::queue_frame(frame f)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		written_cv_.wait(lock, [this] { return queue_.size() < MAX_QUEUED_FRAMES; });
+		queue_.push_back(std::move(f));
+	}
+
+	queued_cv_.notify_one();
+}
+
+void
+frame_capture::writer_loop()
+{
+	for (;;) {
+		frame f;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			queued_cv_.wait(lock, [this] { return quit_ || !queue_.empty(); });
+
+			if (queue_.empty())
+				return;
+
+			f = std::move(queue_.front());
+			queue_.pop_front();
+		}
+
+		write_frame(f);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			free_frames_.push_back(std::move(f));
+		}
+
+		written_cv_.notify_one();
+	}
+}
+
+// full range BT.601, chroma is the average of each 2x2 block; rows are
+// flipped since GL reads them bottom up
+
+void
+frame_capture::write_frame(const frame& rgba)
+{
+	const int chroma_width = width_/2;
+	const int chroma_height = height_/2;
+
+	uint8_t *y_plane = &yuv_[0];
+	uint8_t *u_plane = y_plane + width_*height_;
+	uint8_t *v_plane = u_plane + chroma_width*chroma_height;
+
+	auto pixel = [&] (int x, int y) {
+		return &rgba[4*((height_ - 1 - y)*width_ + x)];
+	};
+
+	for (int y = 0; y < height_; y++) {
+		for (int x = 0; x < width_; x++) {
+			const uint8_t *p = pixel(x, y);
+			*y_plane++ = (77*p[0] + 150*p[1] + 29*p[2] + 128) >> 8;
+		}
+	}
+
+	for (int y = 0; y < chroma_height; y++) {
+		for (int x = 0; x < chroma_width; x++) {
+			int r = 0, g = 0, b = 0;
+
+			for (int i = 0; i < 2; i++) {
+				for (int j = 0; j < 2; j++) {
+					const uint8_t *p = pixel(2*x + j, 2*y + i);
+					r += p[0];
+					g += p[1];
+					b += p[2];
+				}
+			}
+
+			// sums of 4, so shift by 2 more; offset keeps the sums positive
+			*u_plane++ = std::min((-43*r - 85*g + 128*b + (128 << 10) + 512) >> 10, 255);
+			*v_plane++ = std::min((128*r - 107*g - 21*b + (128 << 10) + 512) >> 10, 255);
+		}
+	}
+
+	fputs("FRAME\n", out_);
+	fwrite(&yuv_[0], yuv_.size(), 1, out_);
+}
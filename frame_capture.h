@@ -0,0 +1,65 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <deque>
+
+#include <cstdint>
+#include <cstdio>
+
+// Records the framebuffer into a single Y4M stream, written to a file or,
+// if the path starts with '|', piped to the standard input of a command
+// (e.g. "|ffmpeg -i - hell.gif").
+//
+// Readback goes through a ring of pixel buffer objects: capture() only
+// queues a glReadPixels into the next buffer and maps the one queued
+// NUM_PBOS frames ago, which the GPU is long done with. Color
+// conversion and writing happen on a separate thread.
+
+class frame_capture
+{
+public:
+	frame_capture(int width, int height, int fps, const char *path);
+	~frame_capture();
+
+	void capture();
+
+private:
+	static constexpr int NUM_PBOS = 3;
+
+	// frames waiting for the writer past this block the caller
+	static constexpr size_t MAX_QUEUED_FRAMES = 8;
+
+	using frame = std::vector<uint8_t>;
+
+	void read_back(GLuint pbo);
+	frame get_free_frame();
+	void queue_frame(frame f);
+	void writer_loop();
+	void write_frame(const frame& rgba);
+
+	int width_, height_;
+	bool is_pipe_;
+	FILE *out_;
+
+	GLuint pbos_[NUM_PBOS];
+	bool use_pbos_;
+	int num_frames_;
+
+	std::thread writer_;
+	std::mutex mutex_;
+	std::condition_variable queued_cv_, written_cv_;
+	std::deque<frame> queue_;
+	std::vector<frame> free_frames_;
+	bool quit_;
+
+	// one Y4M frame, planar 4:2:0
+	std::vector<uint8_t> yuv_;
+
+	frame_capture(const frame_capture&) = delete;
+	frame_capture& operator=(const frame_capture&) = delete;
+};
@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <utility>
+
+#include "islands.h"
+
+namespace {
+
+class union_find
+{
+public:
+	union_find(size_t size)
+	: parent_(size)
+	, rank_(size, 0)
+	{
+		for (size_t i = 0; i < size; i++)
+			parent_[i] = i;
+	}
+
+	size_t find(size_t i)
+	{
+		while (parent_[i] != i) {
+			parent_[i] = parent_[parent_[i]];
+			i = parent_[i];
+		}
+
+		return i;
+	}
+
+	void join(size_t a, size_t b)
+	{
+		a = find(a);
+		b = find(b);
+
+		if (a == b)
+			return;
+
+		if (rank_[a] < rank_[b])
+			std::swap(a, b);
+
+		parent_[b] = a;
+
+		if (rank_[a] == rank_[b])
+			++rank_[a];
+	}
+
+private:
+	std::vector<size_t> parent_;
+	std::vector<int> rank_;
+};
+
+// stable counting sort of items into groups; group i ends up in
+// [offsets[i], offsets[i + 1]) of sorted
+
+template <typename T>
+void
+group_by(const std::vector<T>& items, const std::vector<size_t>& item_group, size_t num_groups, std::vector<T>& sorted, std::vector<size_t>& offsets)
+{
+	offsets.assign(num_groups + 1, 0);
+
+	for (size_t i : item_group)
+		++offsets[i + 1];
+
+	for (size_t i = 0; i < num_groups; i++)
+		offsets[i + 1] += offsets[i];
+
+	sorted.resize(items.size());
+
+	std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+
+	for (size_t i = 0; i < items.size(); i++)
+		sorted[next[item_group[i]]++] = items[i];
+}
+
+}
+
+void
+island_set::build(size_t num_proxies, const std::vector<size_t>& member_proxies, const std::vector<proxy_pair>& all_pairs)
+{
+	union_find sets(num_proxies);
+	std::vector<bool> is_member(num_proxies, false);
+
+	for (auto i : member_proxies)
+		is_member[i] = true;
+
+	for (auto& i : all_pairs) {
+		sets.join(i.first, i.second);
+		is_member[i.first] = is_member[i.second] = true;
+	}
+
+	// number islands in order of their lowest proxy
+
+	std::vector<size_t> island_index(num_proxies, SIZE_MAX);
+	std::vector<size_t> members;
+	std::vector<size_t> member_island;
+
+	size_t num_islands = 0;
+
+	for (size_t i = 0; i < num_proxies; i++) {
+		if (!is_member[i])
+			continue;
+
+		size_t& index = island_index[sets.find(i)];
+
+		if (index == SIZE_MAX)
+			index = num_islands++;
+
+		members.push_back(i);
+		member_island.push_back(index);
+	}
+
+	group_by(members, member_island, num_islands, proxies, proxy_offsets);
+
+	std::vector<size_t> pair_island(all_pairs.size());
+
+	for (size_t i = 0; i < all_pairs.size(); i++)
+		pair_island[i] = island_index[sets.find(all_pairs[i].first)];
+
+	group_by(all_pairs, pair_island, num_islands, pairs, pair_offsets);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "broad_phase.h"
+
+// Connected components of the broad-phase pair graph. Islands share no
+// proxies, so each one can be solved independently of the others.
+
+struct island_set
+{
+	// groups proxies plus every proxy in all_pairs; a proxy in no pair is
+	// an island of its own. Islands are numbered in order of their lowest
+	// proxy.
+
+	void build(size_t num_proxies, const std::vector<size_t>& proxies, const std::vector<proxy_pair>& all_pairs);
+
+	size_t size() const
+	{ return proxy_offsets.size() - 1; }
+
+	// proxies of island i are [proxy_offsets[i], proxy_offsets[i + 1]), in
+	// increasing order
+	std::vector<size_t> proxies;
+	std::vector<size_t> proxy_offsets;
+
+	// pairs of island i are [pair_offsets[i], pair_offsets[i + 1]), in the
+	// same relative order as in all_pairs
+	std::vector<proxy_pair> pairs;
+	std::vector<size_t> pair_offsets;
+};
@@ -0,0 +1,684 @@
+#include <algorithm>
+
+#include <cmath>
+#include <cstdint>
+
+#if !defined(SCALAR_KERNELS)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define KERNELS_AVX
+#define KERNELS_SSE
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNELS_SSE
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KERNELS_NEON
+#endif
+#endif
+
+#include "kernels.h"
+
+namespace {
+
+//
+//  s c a l a r
+//
+
+inline void
+integrate_one(float& x, float& y, float& px, float& py, float damping, float gravity)
+{
+	const float vx = damping*(x - px);
+	const float vy = damping*(y - py);
+
+	px = x;
+	py = y;
+
+	x += vx;
+	y += vy - gravity;
+}
+
+inline void
+constrain_one(float& x, float& y, float width, float radius, float friction)
+{
+	if (y > radius) {
+		if (x < 0)
+			x += friction*(-x);
+
+		if (x > width)
+			x += friction*(width - x);
+	} else {
+		const float dx = x - radius;
+		const float dy = y - radius;
+
+		const float r = sqrtf(dx*dx + dy*dy);
+
+		if (r > radius) {
+			const float s = friction*(r - radius)/r;
+			x -= dx*s;
+			y -= dy*s;
+		}
+	}
+}
+
+inline void
+constrain_field_one(float& x, float& y, const kernels::distance_field& field, float friction)
+{
+	float gx, gy;
+	const float d = kernels::sample_field(field, x, y, gx, gy);
+
+	// the gradient of a distance is a unit vector but for filtering error,
+	// so dividing by its length only matters near corners
+
+	const float s = friction*std::max(d, 0.f)/std::max(sqrtf(gx*gx + gy*gy), 1e-3f);
+
+	x -= gx*s;
+	y -= gy*s;
+}
+
+// the corners of the cells at rows i and columns j, for the vector paths;
+// gathering lane by lane is as fast as it gets without AVX2
+
+inline void
+gather_corners(const kernels::distance_field& field, const int32_t *i, const int32_t *j, int lanes, float *d00, float *d10, float *d01, float *d11)
+{
+	for (int k = 0; k < lanes; k++) {
+		const float *row = &field.distances[i[k]*field.cols + j[k]];
+
+		d00[k] = row[0];
+		d10[k] = row[1];
+		d01[k] = row[field.cols];
+		d11[k] = row[field.cols + 1];
+	}
+}
+
+//
+//  s s e
+//
+
+#if defined(KERNELS_SSE)
+
+inline __m128
+select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline void
+integrate_4(float *x, float *y, float *px, float *py, __m128 damping, __m128 gravity)
+{
+	const __m128 x0 = _mm_loadu_ps(x);
+	const __m128 y0 = _mm_loadu_ps(y);
+
+	const __m128 vx = _mm_mul_ps(damping, _mm_sub_ps(x0, _mm_loadu_ps(px)));
+	const __m128 vy = _mm_mul_ps(damping, _mm_sub_ps(y0, _mm_loadu_ps(py)));
+
+	_mm_storeu_ps(px, x0);
+	_mm_storeu_ps(py, y0);
+
+	_mm_storeu_ps(x, _mm_add_ps(x0, vx));
+	_mm_storeu_ps(y, _mm_add_ps(y0, _mm_sub_ps(vy, gravity)));
+}
+
+inline float
+relax_4(float *x, float *y, const spring *s)
+{
+	const __m128 x0 = _mm_setr_ps(x[s[0].p0], x[s[1].p0], x[s[2].p0], x[s[3].p0]);
+	const __m128 y0 = _mm_setr_ps(y[s[0].p0], y[s[1].p0], y[s[2].p0], y[s[3].p0]);
+	const __m128 x1 = _mm_setr_ps(x[s[0].p1], x[s[1].p1], x[s[2].p1], x[s[3].p1]);
+	const __m128 y1 = _mm_setr_ps(y[s[0].p1], y[s[1].p1], y[s[2].p1], y[s[3].p1]);
+	const __m128 rest_length = _mm_setr_ps(s[0].rest_length, s[1].rest_length, s[2].rest_length, s[3].rest_length);
+
+	const __m128 dx = _mm_sub_ps(x1, x0);
+	const __m128 dy = _mm_sub_ps(y1, y0);
+
+	const __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+	const __m128 stretch = _mm_sub_ps(l, rest_length);
+	const __m128 f = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(.5f), stretch), l);
+
+	const __m128 fx = _mm_mul_ps(f, dx);
+	const __m128 fy = _mm_mul_ps(f, dy);
+
+	float rx0[4], ry0[4], rx1[4], ry1[4];
+
+	_mm_storeu_ps(rx0, _mm_add_ps(x0, fx));
+	_mm_storeu_ps(ry0, _mm_add_ps(y0, fy));
+	_mm_storeu_ps(rx1, _mm_sub_ps(x1, fx));
+	_mm_storeu_ps(ry1, _mm_sub_ps(y1, fy));
+
+	for (int i = 0; i < 4; i++) {
+		x[s[i].p0] = rx0[i];
+		y[s[i].p0] = ry0[i];
+		x[s[i].p1] = rx1[i];
+		y[s[i].p1] = ry1[i];
+	}
+
+	// horizontal max of |stretch|
+
+	__m128 m = _mm_andnot_ps(_mm_set1_ps(-0.f), stretch);
+	m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	return _mm_cvtss_f32(m);
+}
+
+inline void
+constrain_4(float *x, float *y, __m128 width, __m128 radius, __m128 friction)
+{
+	__m128 x0 = _mm_loadu_ps(x);
+	__m128 y0 = _mm_loadu_ps(y);
+
+	// straight walls
+
+	const __m128 walls = _mm_cmpgt_ps(y0, radius);
+
+	const __m128 left = _mm_and_ps(walls, _mm_cmplt_ps(x0, _mm_setzero_ps()));
+	x0 = select(left, _mm_add_ps(x0, _mm_mul_ps(friction, _mm_sub_ps(_mm_setzero_ps(), x0))), x0);
+
+	const __m128 right = _mm_and_ps(walls, _mm_cmpgt_ps(x0, width));
+	x0 = select(right, _mm_add_ps(x0, _mm_mul_ps(friction, _mm_sub_ps(width, x0))), x0);
+
+	// bowl
+
+	const __m128 dx = _mm_sub_ps(x0, radius);
+	const __m128 dy = _mm_sub_ps(y0, radius);
+
+	const __m128 r = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+	const __m128 s = _mm_div_ps(_mm_mul_ps(friction, _mm_sub_ps(r, radius)), r);
+
+	const __m128 bowl = _mm_andnot_ps(walls, _mm_cmpgt_ps(r, radius));
+	x0 = select(bowl, _mm_sub_ps(x0, _mm_mul_ps(dx, s)), x0);
+	y0 = select(bowl, _mm_sub_ps(y0, _mm_mul_ps(dy, s)), y0);
+
+	_mm_storeu_ps(x, x0);
+	_mm_storeu_ps(y, y0);
+}
+
+// min and max take their operands in the order that keeps std::min and
+// std::max's choice, down to the sign of zero
+
+inline void
+constrain_field_4(float *x, float *y, const kernels::distance_field& field, __m128 friction)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 cell = _mm_set1_ps(field.cell_size);
+
+	__m128 x0 = _mm_loadu_ps(x);
+	__m128 y0 = _mm_loadu_ps(y);
+
+	const __m128 fx = _mm_div_ps(_mm_sub_ps(x0, _mm_set1_ps(field.origin_x)), cell);
+	const __m128 fy = _mm_div_ps(_mm_sub_ps(y0, _mm_set1_ps(field.origin_y)), cell);
+
+	const __m128 cx = _mm_min_ps(_mm_set1_ps(field.cols - 1.f), _mm_max_ps(zero, fx));
+	const __m128 cy = _mm_min_ps(_mm_set1_ps(field.rows - 1.f), _mm_max_ps(zero, fy));
+
+	const __m128 ex = _mm_mul_ps(_mm_sub_ps(fx, cx), cell);
+	const __m128 ey = _mm_mul_ps(_mm_min_ps(zero, fy), cell);
+
+	// cx and cy aren't negative, so truncating floors them
+
+	const __m128 j = _mm_min_ps(_mm_set1_ps(field.cols - 2.f), _mm_cvtepi32_ps(_mm_cvttps_epi32(cx)));
+	const __m128 i = _mm_min_ps(_mm_set1_ps(field.rows - 2.f), _mm_cvtepi32_ps(_mm_cvttps_epi32(cy)));
+
+	alignas(16) int32_t rows[4], cols[4];
+	_mm_store_si128(reinterpret_cast<__m128i *>(rows), _mm_cvttps_epi32(i));
+	_mm_store_si128(reinterpret_cast<__m128i *>(cols), _mm_cvttps_epi32(j));
+
+	alignas(16) float c00[4], c10[4], c01[4], c11[4];
+	gather_corners(field, rows, cols, 4, c00, c10, c01, c11);
+
+	const __m128 d00 = _mm_load_ps(c00), d10 = _mm_load_ps(c10);
+	const __m128 d01 = _mm_load_ps(c01), d11 = _mm_load_ps(c11);
+
+	const __m128 u = _mm_sub_ps(cx, j);
+	const __m128 v = _mm_sub_ps(cy, i);
+	const __m128 iu = _mm_sub_ps(one, u);
+	const __m128 iv = _mm_sub_ps(one, v);
+
+	const __m128 gx = _mm_div_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(d10, d00), iv), _mm_mul_ps(_mm_sub_ps(d11, d01), v)), cell);
+	const __m128 gy = _mm_div_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(d01, d00), iu), _mm_mul_ps(_mm_sub_ps(d11, d10), u)), cell);
+
+	const __m128 d = _mm_add_ps(
+		_mm_mul_ps(_mm_add_ps(_mm_mul_ps(d00, iu), _mm_mul_ps(d10, u)), iv),
+		_mm_mul_ps(_mm_add_ps(_mm_mul_ps(d01, iu), _mm_mul_ps(d11, u)), v));
+
+	const __m128 distance = _mm_add_ps(d, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey))));
+	const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)));
+
+	const __m128 s = _mm_div_ps(_mm_mul_ps(friction, _mm_max_ps(zero, distance)), _mm_max_ps(_mm_set1_ps(1e-3f), length));
+
+	x0 = _mm_sub_ps(x0, _mm_mul_ps(gx, s));
+	y0 = _mm_sub_ps(y0, _mm_mul_ps(gy, s));
+
+	_mm_storeu_ps(x, x0);
+	_mm_storeu_ps(y, y0);
+}
+
+#endif
+
+//
+//  a v x
+//
+
+#if defined(KERNELS_AVX)
+
+inline void
+integrate_8(float *x, float *y, float *px, float *py, __m256 damping, __m256 gravity)
+{
+	const __m256 x0 = _mm256_loadu_ps(x);
+	const __m256 y0 = _mm256_loadu_ps(y);
+
+	const __m256 vx = _mm256_mul_ps(damping, _mm256_sub_ps(x0, _mm256_loadu_ps(px)));
+	const __m256 vy = _mm256_mul_ps(damping, _mm256_sub_ps(y0, _mm256_loadu_ps(py)));
+
+	_mm256_storeu_ps(px, x0);
+	_mm256_storeu_ps(py, y0);
+
+	_mm256_storeu_ps(x, _mm256_add_ps(x0, vx));
+	_mm256_storeu_ps(y, _mm256_add_ps(y0, _mm256_sub_ps(vy, gravity)));
+}
+
+inline void
+constrain_8(float *x, float *y, __m256 width, __m256 radius, __m256 friction)
+{
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256 x0 = _mm256_loadu_ps(x);
+	__m256 y0 = _mm256_loadu_ps(y);
+
+	// straight walls
+
+	const __m256 walls = _mm256_cmp_ps(y0, radius, _CMP_GT_OQ);
+
+	const __m256 left = _mm256_and_ps(walls, _mm256_cmp_ps(x0, zero, _CMP_LT_OQ));
+	x0 = _mm256_blendv_ps(x0, _mm256_add_ps(x0, _mm256_mul_ps(friction, _mm256_sub_ps(zero, x0))), left);
+
+	const __m256 right = _mm256_and_ps(walls, _mm256_cmp_ps(x0, width, _CMP_GT_OQ));
+	x0 = _mm256_blendv_ps(x0, _mm256_add_ps(x0, _mm256_mul_ps(friction, _mm256_sub_ps(width, x0))), right);
+
+	// bowl
+
+	const __m256 dx = _mm256_sub_ps(x0, radius);
+	const __m256 dy = _mm256_sub_ps(y0, radius);
+
+	const __m256 r = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+	const __m256 s = _mm256_div_ps(_mm256_mul_ps(friction, _mm256_sub_ps(r, radius)), r);
+
+	const __m256 bowl = _mm256_andnot_ps(walls, _mm256_cmp_ps(r, radius, _CMP_GT_OQ));
+	x0 = _mm256_blendv_ps(x0, _mm256_sub_ps(x0, _mm256_mul_ps(dx, s)), bowl);
+	y0 = _mm256_blendv_ps(y0, _mm256_sub_ps(y0, _mm256_mul_ps(dy, s)), bowl);
+
+	_mm256_storeu_ps(x, x0);
+	_mm256_storeu_ps(y, y0);
+}
+
+inline void
+constrain_field_8(float *x, float *y, const kernels::distance_field& field, __m256 friction)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1);
+	const __m256 cell = _mm256_set1_ps(field.cell_size);
+
+	__m256 x0 = _mm256_loadu_ps(x);
+	__m256 y0 = _mm256_loadu_ps(y);
+
+	const __m256 fx = _mm256_div_ps(_mm256_sub_ps(x0, _mm256_set1_ps(field.origin_x)), cell);
+	const __m256 fy = _mm256_div_ps(_mm256_sub_ps(y0, _mm256_set1_ps(field.origin_y)), cell);
+
+	const __m256 cx = _mm256_min_ps(_mm256_set1_ps(field.cols - 1.f), _mm256_max_ps(zero, fx));
+	const __m256 cy = _mm256_min_ps(_mm256_set1_ps(field.rows - 1.f), _mm256_max_ps(zero, fy));
+
+	const __m256 ex = _mm256_mul_ps(_mm256_sub_ps(fx, cx), cell);
+	const __m256 ey = _mm256_mul_ps(_mm256_min_ps(zero, fy), cell);
+
+	const __m256 j = _mm256_min_ps(_mm256_set1_ps(field.cols - 2.f), _mm256_cvtepi32_ps(_mm256_cvttps_epi32(cx)));
+	const __m256 i = _mm256_min_ps(_mm256_set1_ps(field.rows - 2.f), _mm256_cvtepi32_ps(_mm256_cvttps_epi32(cy)));
+
+	alignas(32) int32_t rows[8], cols[8];
+	_mm256_store_si256(reinterpret_cast<__m256i *>(rows), _mm256_cvttps_epi32(i));
+	_mm256_store_si256(reinterpret_cast<__m256i *>(cols), _mm256_cvttps_epi32(j));
+
+	alignas(32) float c00[8], c10[8], c01[8], c11[8];
+	gather_corners(field, rows, cols, 8, c00, c10, c01, c11);
+
+	const __m256 d00 = _mm256_load_ps(c00), d10 = _mm256_load_ps(c10);
+	const __m256 d01 = _mm256_load_ps(c01), d11 = _mm256_load_ps(c11);
+
+	const __m256 u = _mm256_sub_ps(cx, j);
+	const __m256 v = _mm256_sub_ps(cy, i);
+	const __m256 iu = _mm256_sub_ps(one, u);
+	const __m256 iv = _mm256_sub_ps(one, v);
+
+	const __m256 gx = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(d10, d00), iv), _mm256_mul_ps(_mm256_sub_ps(d11, d01), v)), cell);
+	const __m256 gy = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(d01, d00), iu), _mm256_mul_ps(_mm256_sub_ps(d11, d10), u)), cell);
+
+	const __m256 d = _mm256_add_ps(
+		_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(d00, iu), _mm256_mul_ps(d10, u)), iv),
+		_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(d01, iu), _mm256_mul_ps(d11, u)), v));
+
+	const __m256 distance = _mm256_add_ps(d, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey))));
+	const __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy)));
+
+	const __m256 s = _mm256_div_ps(_mm256_mul_ps(friction, _mm256_max_ps(zero, distance)), _mm256_max_ps(_mm256_set1_ps(1e-3f), length));
+
+	x0 = _mm256_sub_ps(x0, _mm256_mul_ps(gx, s));
+	y0 = _mm256_sub_ps(y0, _mm256_mul_ps(gy, s));
+
+	_mm256_storeu_ps(x, x0);
+	_mm256_storeu_ps(y, y0);
+}
+
+#endif
+
+//
+//  n e o n
+//
+
+#if defined(KERNELS_NEON)
+
+inline void
+integrate_4(float *x, float *y, float *px, float *py, float32x4_t damping, float32x4_t gravity)
+{
+	const float32x4_t x0 = vld1q_f32(x);
+	const float32x4_t y0 = vld1q_f32(y);
+
+	const float32x4_t vx = vmulq_f32(damping, vsubq_f32(x0, vld1q_f32(px)));
+	const float32x4_t vy = vmulq_f32(damping, vsubq_f32(y0, vld1q_f32(py)));
+
+	vst1q_f32(px, x0);
+	vst1q_f32(py, y0);
+
+	vst1q_f32(x, vaddq_f32(x0, vx));
+	vst1q_f32(y, vaddq_f32(y0, vsubq_f32(vy, gravity)));
+}
+
+inline float
+relax_4(float *x, float *y, const spring *s)
+{
+	const float ax0[4] = { x[s[0].p0], x[s[1].p0], x[s[2].p0], x[s[3].p0] };
+	const float ay0[4] = { y[s[0].p0], y[s[1].p0], y[s[2].p0], y[s[3].p0] };
+	const float ax1[4] = { x[s[0].p1], x[s[1].p1], x[s[2].p1], x[s[3].p1] };
+	const float ay1[4] = { y[s[0].p1], y[s[1].p1], y[s[2].p1], y[s[3].p1] };
+	const float ar[4] = { s[0].rest_length, s[1].rest_length, s[2].rest_length, s[3].rest_length };
+
+	const float32x4_t x0 = vld1q_f32(ax0);
+	const float32x4_t y0 = vld1q_f32(ay0);
+	const float32x4_t x1 = vld1q_f32(ax1);
+	const float32x4_t y1 = vld1q_f32(ay1);
+
+	const float32x4_t dx = vsubq_f32(x1, x0);
+	const float32x4_t dy = vsubq_f32(y1, y0);
+
+	// vmulq + vaddq rather than vmlaq, which would fuse on AArch64
+
+	const float32x4_t l = vsqrtq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)));
+	const float32x4_t stretch = vsubq_f32(l, vld1q_f32(ar));
+	const float32x4_t f = vdivq_f32(vmulq_f32(vdupq_n_f32(.5f), stretch), l);
+
+	const float32x4_t fx = vmulq_f32(f, dx);
+	const float32x4_t fy = vmulq_f32(f, dy);
+
+	float rx0[4], ry0[4], rx1[4], ry1[4];
+
+	vst1q_f32(rx0, vaddq_f32(x0, fx));
+	vst1q_f32(ry0, vaddq_f32(y0, fy));
+	vst1q_f32(rx1, vsubq_f32(x1, fx));
+	vst1q_f32(ry1, vsubq_f32(y1, fy));
+
+	for (int i = 0; i < 4; i++) {
+		x[s[i].p0] = rx0[i];
+		y[s[i].p0] = ry0[i];
+		x[s[i].p1] = rx1[i];
+		y[s[i].p1] = ry1[i];
+	}
+
+	return vmaxvq_f32(vabsq_f32(stretch));
+}
+
+inline void
+constrain_4(float *x, float *y, float32x4_t width, float32x4_t radius, float32x4_t friction)
+{
+	const float32x4_t zero = vdupq_n_f32(0);
+
+	float32x4_t x0 = vld1q_f32(x);
+	float32x4_t y0 = vld1q_f32(y);
+
+	// straight walls
+
+	const uint32x4_t walls = vcgtq_f32(y0, radius);
+
+	const uint32x4_t left = vandq_u32(walls, vcltq_f32(x0, zero));
+	x0 = vbslq_f32(left, vaddq_f32(x0, vmulq_f32(friction, vsubq_f32(zero, x0))), x0);
+
+	const uint32x4_t right = vandq_u32(walls, vcgtq_f32(x0, width));
+	x0 = vbslq_f32(right, vaddq_f32(x0, vmulq_f32(friction, vsubq_f32(width, x0))), x0);
+
+	// bowl
+
+	const float32x4_t dx = vsubq_f32(x0, radius);
+	const float32x4_t dy = vsubq_f32(y0, radius);
+
+	const float32x4_t r = vsqrtq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)));
+	const float32x4_t s = vdivq_f32(vmulq_f32(friction, vsubq_f32(r, radius)), r);
+
+	const uint32x4_t bowl = vbicq_u32(vcgtq_f32(r, radius), walls);
+	x0 = vbslq_f32(bowl, vsubq_f32(x0, vmulq_f32(dx, s)), x0);
+	y0 = vbslq_f32(bowl, vsubq_f32(y0, vmulq_f32(dy, s)), y0);
+
+	vst1q_f32(x, x0);
+	vst1q_f32(y, y0);
+}
+
+// NEON's min and max turn -0 into +0, so the clamps are done with selects
+// that pick the same operand std::min and std::max would
+
+inline void
+constrain_field_4(float *x, float *y, const kernels::distance_field& field, float32x4_t friction)
+{
+	const float32x4_t zero = vdupq_n_f32(0);
+	const float32x4_t one = vdupq_n_f32(1);
+	const float32x4_t cell = vdupq_n_f32(field.cell_size);
+	const float32x4_t max_col = vdupq_n_f32(field.cols - 1.f);
+	const float32x4_t max_row = vdupq_n_f32(field.rows - 1.f);
+	const float32x4_t last_col = vdupq_n_f32(field.cols - 2.f);
+	const float32x4_t last_row = vdupq_n_f32(field.rows - 2.f);
+	const float32x4_t min_length = vdupq_n_f32(1e-3f);
+
+	float32x4_t x0 = vld1q_f32(x);
+	float32x4_t y0 = vld1q_f32(y);
+
+	const float32x4_t fx = vdivq_f32(vsubq_f32(x0, vdupq_n_f32(field.origin_x)), cell);
+	const float32x4_t fy = vdivq_f32(vsubq_f32(y0, vdupq_n_f32(field.origin_y)), cell);
+
+	const float32x4_t px = vbslq_f32(vcltq_f32(fx, zero), zero, fx);
+	const float32x4_t py = vbslq_f32(vcltq_f32(fy, zero), zero, fy);
+	const float32x4_t cx = vbslq_f32(vcltq_f32(max_col, px), max_col, px);
+	const float32x4_t cy = vbslq_f32(vcltq_f32(max_row, py), max_row, py);
+
+	const float32x4_t ex = vmulq_f32(vsubq_f32(fx, cx), cell);
+	const float32x4_t ey = vmulq_f32(vbslq_f32(vcltq_f32(zero, fy), zero, fy), cell);
+
+	const float32x4_t tx = vcvtq_f32_s32(vcvtq_s32_f32(cx));
+	const float32x4_t ty = vcvtq_f32_s32(vcvtq_s32_f32(cy));
+	const float32x4_t j = vbslq_f32(vcltq_f32(last_col, tx), last_col, tx);
+	const float32x4_t i = vbslq_f32(vcltq_f32(last_row, ty), last_row, ty);
+
+	int32_t rows[4], cols[4];
+	vst1q_s32(rows, vcvtq_s32_f32(i));
+	vst1q_s32(cols, vcvtq_s32_f32(j));
+
+	float c00[4], c10[4], c01[4], c11[4];
+	gather_corners(field, rows, cols, 4, c00, c10, c01, c11);
+
+	const float32x4_t d00 = vld1q_f32(c00), d10 = vld1q_f32(c10);
+	const float32x4_t d01 = vld1q_f32(c01), d11 = vld1q_f32(c11);
+
+	const float32x4_t u = vsubq_f32(cx, j);
+	const float32x4_t v = vsubq_f32(cy, i);
+	const float32x4_t iu = vsubq_f32(one, u);
+	const float32x4_t iv = vsubq_f32(one, v);
+
+	const float32x4_t gx = vdivq_f32(vaddq_f32(vmulq_f32(vsubq_f32(d10, d00), iv), vmulq_f32(vsubq_f32(d11, d01), v)), cell);
+	const float32x4_t gy = vdivq_f32(vaddq_f32(vmulq_f32(vsubq_f32(d01, d00), iu), vmulq_f32(vsubq_f32(d11, d10), u)), cell);
+
+	const float32x4_t d = vaddq_f32(
+		vmulq_f32(vaddq_f32(vmulq_f32(d00, iu), vmulq_f32(d10, u)), iv),
+		vmulq_f32(vaddq_f32(vmulq_f32(d01, iu), vmulq_f32(d11, u)), v));
+
+	const float32x4_t distance = vaddq_f32(d, vsqrtq_f32(vaddq_f32(vmulq_f32(ex, ex), vmulq_f32(ey, ey))));
+	const float32x4_t length = vsqrtq_f32(vaddq_f32(vmulq_f32(gx, gx), vmulq_f32(gy, gy)));
+
+	const float32x4_t push = vbslq_f32(vcltq_f32(distance, zero), zero, distance);
+	const float32x4_t divisor = vbslq_f32(vcltq_f32(length, min_length), min_length, length);
+
+	const float32x4_t s = vdivq_f32(vmulq_f32(friction, push), divisor);
+
+	x0 = vsubq_f32(x0, vmulq_f32(gx, s));
+	y0 = vsubq_f32(y0, vmulq_f32(gy, s));
+
+	vst1q_f32(x, x0);
+	vst1q_f32(y, y0);
+}
+
+#endif
+
+}
+
+namespace kernels {
+
+void
+integrate(float *x, float *y, float *px, float *py, size_t count, float damping, float gravity)
+{
+	size_t i = 0;
+
+#if defined(KERNELS_AVX)
+	{
+		const __m256 d = _mm256_set1_ps(damping);
+		const __m256 g = _mm256_set1_ps(gravity);
+
+		for (; i + 8 <= count; i += 8)
+			integrate_8(&x[i], &y[i], &px[i], &py[i], d, g);
+	}
+#endif
+
+#if defined(KERNELS_SSE)
+	{
+		const __m128 d = _mm_set1_ps(damping);
+		const __m128 g = _mm_set1_ps(gravity);
+
+		for (; i + 4 <= count; i += 4)
+			integrate_4(&x[i], &y[i], &px[i], &py[i], d, g);
+	}
+#elif defined(KERNELS_NEON)
+	{
+		const float32x4_t d = vdupq_n_f32(damping);
+		const float32x4_t g = vdupq_n_f32(gravity);
+
+		for (; i + 4 <= count; i += 4)
+			integrate_4(&x[i], &y[i], &px[i], &py[i], d, g);
+	}
+#endif
+
+	for (; i < count; i++)
+		integrate_one(x[i], y[i], px[i], py[i], damping, gravity);
+}
+
+float
+relax_springs(float *x, float *y, const spring *springs, const size_t *color_offsets, size_t num_colors)
+{
+	float stretch = 0;
+
+	for (size_t c = 0; c < num_colors; c++) {
+		size_t i = color_offsets[c];
+		const size_t end = color_offsets[c + 1];
+
+#if defined(KERNELS_SSE) || defined(KERNELS_NEON)
+		for (; i + 4 <= end; i += 4)
+			stretch = std::max(stretch, relax_4(x, y, &springs[i]));
+#endif
+
+		for (; i < end; i++)
+			stretch = std::max(stretch, relax_spring(x, y, springs[i]));
+	}
+
+	return stretch;
+}
+
+void
+constrain_to_bowl(float *x, float *y, size_t count, float width, float friction)
+{
+	const float radius = .5f*width;
+
+	size_t i = 0;
+
+#if defined(KERNELS_AVX)
+	{
+		const __m256 w = _mm256_set1_ps(width);
+		const __m256 r = _mm256_set1_ps(radius);
+		const __m256 f = _mm256_set1_ps(friction);
+
+		for (; i + 8 <= count; i += 8)
+			constrain_8(&x[i], &y[i], w, r, f);
+	}
+#endif
+
+#if defined(KERNELS_SSE)
+	{
+		const __m128 w = _mm_set1_ps(width);
+		const __m128 r = _mm_set1_ps(radius);
+		const __m128 f = _mm_set1_ps(friction);
+
+		for (; i + 4 <= count; i += 4)
+			constrain_4(&x[i], &y[i], w, r, f);
+	}
+#elif defined(KERNELS_NEON)
+	{
+		const float32x4_t w = vdupq_n_f32(width);
+		const float32x4_t r = vdupq_n_f32(radius);
+		const float32x4_t f = vdupq_n_f32(friction);
+
+		for (; i + 4 <= count; i += 4)
+			constrain_4(&x[i], &y[i], w, r, f);
+	}
+#endif
+
+	for (; i < count; i++)
+		constrain_one(x[i], y[i], width, radius, friction);
+}
+
+void
+constrain_to_field(float *x, float *y, size_t count, const distance_field& field, float friction)
+{
+	size_t i = 0;
+
+#if defined(KERNELS_AVX)
+	{
+		const __m256 f = _mm256_set1_ps(friction);
+
+		for (; i + 8 <= count; i += 8)
+			constrain_field_8(&x[i], &y[i], field, f);
+	}
+#endif
+
+#if defined(KERNELS_SSE)
+	{
+		const __m128 f = _mm_set1_ps(friction);
+
+		for (; i + 4 <= count; i += 4)
+			constrain_field_4(&x[i], &y[i], field, f);
+	}
+#elif defined(KERNELS_NEON)
+	{
+		const float32x4_t f = vdupq_n_f32(friction);
+
+		for (; i + 4 <= count; i += 4)
+			constrain_field_4(&x[i], &y[i], field, f);
+	}
+#endif
+
+	for (; i < count; i++)
+		constrain_field_one(x[i], y[i], field, friction);
+}
+
+}
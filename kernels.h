@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+
+#include <cstddef>
+#include <cmath>
+
+struct spring
+{
+	int p0, p1;
+	float rest_length;
+};
+
+// Solver inner loops over structure-of-arrays particle data. Vectorized with
+// SSE/AVX or NEON where available (define SCALAR_KERNELS to turn that off);
+// the vector paths use only correctly rounded operations in the same order
+// as the scalar code, so every path produces bit-identical results.
+
+namespace kernels {
+
+void
+integrate(float *x, float *y, float *px, float *py, size_t count, float damping, float gravity);
+
+// Springs are grouped by color: no two springs in [color_offsets[i],
+// color_offsets[i + 1]) share a particle, which lets each color be relaxed
+// several springs at a time with the same result as one by one.
+//
+// Returns the largest stretch, |length - rest length|, found before
+// relaxing.
+
+float
+relax_springs(float *x, float *y, const spring *springs, const size_t *color_offsets, size_t num_colors);
+
+// a single spring, inline so callers that know their springs at compile
+// time can unroll over them; returns its stretch
+
+inline float
+relax_spring(float *x, float *y, const spring& s)
+{
+	const float dx = x[s.p1] - x[s.p0];
+	const float dy = y[s.p1] - y[s.p0];
+
+	const float l = sqrtf(dx*dx + dy*dy);
+	const float f = .5f*(l - s.rest_length)/l;
+
+	x[s.p0] += f*dx;
+	y[s.p0] += f*dy;
+
+	x[s.p1] -= f*dx;
+	y[s.p1] -= f*dy;
+
+	return fabsf(l - s.rest_length);
+}
+
+// Walls at x = 0 and x = width, closed by a half circle of radius width/2
+// at the bottom.
+
+void
+constrain_to_bowl(float *x, float *y, size_t count, float width, float friction);
+
+// Signed distances at the corners of square cells, rows bottom up from
+// origin. Past the sides or the bottom, the distance to the edge of the
+// grid is added on; above the top, the top row stands for everything over
+// it.
+
+struct distance_field
+{
+	const float *distances;
+	int cols, rows;
+	float origin_x, origin_y;
+	float cell_size;
+};
+
+// bilinear filtered distance and its gradient at (px, py)
+
+inline float
+sample_field(const distance_field& field, float px, float py, float& gx, float& gy)
+{
+	const float fx = (px - field.origin_x)/field.cell_size;
+	const float fy = (py - field.origin_y)/field.cell_size;
+
+	const float cx = std::min(std::max(fx, 0.f), field.cols - 1.f);
+	const float cy = std::min(std::max(fy, 0.f), field.rows - 1.f);
+
+	const float ex = (fx - cx)*field.cell_size;
+	const float ey = std::min(fy, 0.f)*field.cell_size;
+
+	const int j = std::min(static_cast<int>(cx), field.cols - 2);
+	const int i = std::min(static_cast<int>(cy), field.rows - 2);
+
+	const float u = cx - j;
+	const float v = cy - i;
+
+	const float *row = &field.distances[i*field.cols + j];
+
+	const float d00 = row[0], d10 = row[1];
+	const float d01 = row[field.cols], d11 = row[field.cols + 1];
+
+	gx = ((d10 - d00)*(1 - v) + (d11 - d01)*v)/field.cell_size;
+	gy = ((d01 - d00)*(1 - u) + (d11 - d10)*u)/field.cell_size;
+
+	const float d = (d00*(1 - u) + d10*u)*(1 - v) + (d01*(1 - u) + d11*u)*v;
+
+	return d + sqrtf(ex*ex + ey*ey);
+}
+
+// Moves every particle outside field friction of the way back in, along
+// the filtered gradient. The vector paths gather cell corners one lane at
+// a time and do the rest of the filtering and the push across lanes.
+
+void
+constrain_to_field(float *x, float *y, size_t count, const distance_field& field, float friction);
+
+}
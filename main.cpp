@@ -1,24 +1,61 @@
 #include <SDL.h>
 #include <GL/glew.h>
 
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <memory>
+
+#include <unistd.h>
+
 #include "panic.h"
 #include "world.h"
+#include "world_renderer.h"
+#include "screen.h"
+#include "sim_thread.h"
+#include "profiler.h"
+#include "profiler_overlay.h"
+#include "frame_capture.h"
+#include "replay.h"
 
 namespace {
-constexpr int WINDOW_WIDTH = 240;
-constexpr int WINDOW_HEIGHT = 320;
+// frame coordinates, which the world and its border are laid out in
+// whatever the size of the window
+constexpr int FRAME_WIDTH = 240;
+constexpr int FRAME_HEIGHT = 320;
 constexpr int BORDER = 8;
+
+constexpr int DEFAULT_SIM_RATE = 60;
+constexpr int DEFAULT_RENDER_RATE = 30;
 }
 
 static bool running = false;
 
+static int window_width = FRAME_WIDTH;
+static int window_height = FRAME_HEIGHT;
+static int resolution_width = 0;
+static int resolution_height = 0;
+static int sim_rate = DEFAULT_SIM_RATE;
+static int render_rate = DEFAULT_RENDER_RATE;
+static bool show_profiler = false;
+static const char *trace_path = nullptr;
+static const char *capture_path = nullptr;
+static const char *record_path = nullptr;
+static const char *playback_path = nullptr;
+static const char *texture_cache_dir = nullptr;
+static bool compress_textures = false;
+static bool instanced = false;
+static solver_options solver;
+static uint32_t seed = time(nullptr);
+
 static void
 init_sdl()
 {
 	if (SDL_Init(SDL_INIT_VIDEO) < 0)
 		panic("SDL_Init: %s", SDL_GetError());
 
-	if (SDL_SetVideoMode(WINDOW_WIDTH, WINDOW_HEIGHT, 0, SDL_OPENGL) == 0)
+	if (SDL_SetVideoMode(window_width, window_height, 0, SDL_OPENGL) == 0)
 		panic("SDL_SetVideoMode: %s", SDL_GetError());
 }
 
@@ -34,18 +71,12 @@ init_glew()
 static void
 init_gl_state()
 {
-	glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-
-	glClearColor(0, 0, 0, 0);
+	if (!GLEW_VERSION_2_0)
+		panic("OpenGL 2.0 is needed for shaders");
 
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
+	glViewport(0, 0, window_width, window_height);
 
-	glOrtho(0, WINDOW_WIDTH, 0, WINDOW_HEIGHT, -1, 1);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-
-	glPolygonMode(GL_FRONT, GL_FILL);
+	glClearColor(0, 0, 0, 0);
 }
 
 static void
@@ -82,86 +113,267 @@ handle_events()
 			case SDL_KEYDOWN:
 				if (event.key.keysym.sym == SDLK_ESCAPE)
 					running = false;
+				else if (event.key.keysym.sym == SDLK_F1)
+					show_profiler = !show_profiler;
 				break;
 		}
 	}
 }
 
-#ifdef DUMP_FRAMES
-static void
-dump_frame(int frame_num)
+void
+game_loop()
 {
-	static char buffer[3*WINDOW_WIDTH*WINDOW_HEIGHT];
+	const int world_width = FRAME_WIDTH - 2*BORDER;
+	const int world_height = FRAME_HEIGHT - 2*BORDER;
 
-	glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, buffer); 
+	world_options options;
+	options.seed = seed;
+	options.solver = solver;
+	options.clear_rows = true;
 
-	char path[80];
-	sprintf(path, "%05d.ppm", frame_num);
+	replay_log playback;
 
-	FILE *out = fopen(path, "wb");
-	if (!out)
-		return;
+	// only for logs recorded with hell-bench -f
+	const container field_walls = container::make_outline(container::make_bowl(world_width, world_height).get_outline());
 
-	fprintf(out, "P6\n%d %d\n255\n", WINDOW_WIDTH, WINDOW_HEIGHT);
-	fwrite(buffer, sizeof buffer, 1, out);
+	if (playback_path) {
+		if (!playback.load(playback_path))
+			panic("failed to load %s", playback_path);
 
-	fclose(out);
+		if (playback.get_width() != world_width || playback.get_height() != world_height)
+			panic("%s was recorded on a %dx%d world", playback_path, playback.get_width(), playback.get_height());
 
-	++frame_num;
-}
-#endif
+		options.seed = playback.get_seed();
+		options.allow_sleeping = playback.get_allow_sleeping();
+		options.solver = playback.get_solver();
+		options.clear_rows = playback.get_clear_rows();
+		options.playback = &playback;
 
-void
-game_loop()
-{
-	world w(WINDOW_WIDTH - 2*BORDER, WINDOW_HEIGHT - 2*BORDER);
+		if (playback.get_walls() == replay_log::walls_kind::BOWL_FIELD)
+			options.walls = &field_walls;
+	}
+
+	const auto walls = options.walls ? replay_log::walls_kind::BOWL_FIELD : replay_log::walls_kind::BOWL;
+
+	replay_log record(options.seed, world_width, world_height, options.allow_sleeping, options.solver, options.clear_rows, walls);
+
+	if (record_path)
+		options.record = &record;
+
+	world w(world_width, world_height, options);
+
+	screen scr(window_width, window_height, FRAME_WIDTH, FRAME_HEIGHT, resolution_width, resolution_height);
+
+	world_renderer renderer(w, texture_cache_dir, compress_textures, scr.get_scale(), instanced);
 
-#ifdef DUMP_FRAMES
-	int cur_frame = 0;
-#endif
+	// the world inside the border of the frame; the profiler is drawn over
+	// the scaled frame, in window coordinates with y up
+
+	const gge::mat4 world_transform = scr.get_projection()*gge::mat4::translation(BORDER, BORDER);
+	const gge::mat4 window_projection = gge::mat4::ortho(0, window_width, 0, window_height);
+
+	const double update_interval = 1000./sim_rate;
+	const double frame_interval = render_rate > 0 ? 1000./render_rate : 0;
+
+	profiler_overlay overlay(window_width, window_height, frame_interval > 0 ? frame_interval : update_interval);
+
+	if (trace_path && !profiler::get_instance().start_trace(trace_path))
+		panic("failed to open %s", trace_path);
+
+	// unlimited frames are captured at the simulation rate instead, at
+	// most one per update interval, to match the rate in the header
+
+	std::unique_ptr<frame_capture> capture;
+	const double capture_interval = frame_interval > 0 ? 0 : update_interval;
+
+	if (capture_path)
+		capture.reset(new frame_capture(window_width, window_height, render_rate > 0 ? render_rate : sim_rate, capture_path));
 
 	running = true;
 
-	static const int FRAME_INTERVAL = 33;
+	// the world takes fixed steps on its own thread, rendering interpolates
+	// between the last two states it published
+
+	sim_thread sim(w, sim_rate);
 
-	Uint32 next_frame = SDL_GetTicks() + FRAME_INTERVAL;
+	double next_frame = SDL_GetTicks() + frame_interval;
+	double next_capture = SDL_GetTicks();
 
 	while (running) {
 		handle_events();
 
-		w.update();
-		w.update();
+		float alpha;
+		const world_snapshot& snapshot = sim.acquire(alpha);
+
+		{
+			profile_scope scope(profile_section::DRAW);
+
+			scr.begin_frame();
+			renderer.draw(snapshot, world_transform, alpha);
+			scr.end_frame();
+		}
+
+		if (show_profiler)
+			overlay.draw(window_projection);
+
+		if (capture && SDL_GetTicks() >= next_capture) {
+			profile_scope scope(profile_section::CAPTURE);
+			capture->capture();
+
+			next_capture = std::max(next_capture + capture_interval, static_cast<double>(SDL_GetTicks()));
+		}
+
+		{
+			profile_scope scope(profile_section::SWAP);
+			SDL_GL_SwapBuffers();
+		}
+
+		profiler::get_instance().end_frame();
+
+		if (frame_interval > 0) {
+			const Uint32 ticks = SDL_GetTicks();
+
+			if (ticks < next_frame)
+				SDL_Delay(next_frame - ticks);
+
+			// don't try to make up for frames that ran long
+			next_frame = std::max(next_frame + frame_interval, static_cast<double>(ticks));
+		}
+	}
+
+	sim.stop();
+
+	if (record_path) {
+		record.set_num_updates(w.get_num_updates());
+
+		if (!record.save(record_path))
+			panic("failed to write %s", record_path);
+	}
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -s rate  simulation updates per second (default %d)\n"
+		"  -r rate  frames per second, 0 for unlimited (default %d)\n"
+		"  -p       show the profiler overlay (toggle with F1)\n"
+		"  -T file  write a Chrome trace of every frame to file\n"
+		"  -c file  record every frame to a Y4M file, or pipe it to a command\n"
+		"           if file starts with '|' (e.g. '|ffmpeg -i - hell.gif');\n"
+		"           with -r 0, frames are taken at the simulation rate\n"
+		"  -S seed  random seed (default: current time)\n"
+		"  -w file  record a replay to file\n"
+		"  -l file  play back a replay from file\n"
+		"  -m n     fewest solver passes per update (default %d)\n"
+		"  -i n     most solver passes per update (default %d)\n"
+		"  -e err   stop solving once no spring or contact is off by more than\n"
+		"           err, 0 to always run every pass (default %g)\n"
+		"  -C dir   cache generated textures in dir\n"
+		"  -z       block compress textures (DXT1 or ETC2, whichever the GL takes)\n"
+		"  -I       draw pieces of one shape as instances of a single mesh, if the\n"
+		"           GL has buffer textures\n"
+		"  -g WxH   window size (default %dx%d)\n"
+		"  -R WxH   draw at this resolution and scale to the window, if the GL\n"
+		"           can (default: the window's)\n",
+		argv0, DEFAULT_SIM_RATE, DEFAULT_RENDER_RATE, solver_options().min_iterations, solver_options().max_iterations, solver_options().tolerance, FRAME_WIDTH, FRAME_HEIGHT);
+	exit(1);
+}
 
-		glClear(GL_COLOR_BUFFER_BIT);
+static bool
+parse_size(const char *str, int& width, int& height)
+{
+	return sscanf(str, "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+}
 
-		glPushMatrix();
-		glTranslatef(BORDER, BORDER, 0);
+static void
+parse_options(int argc, char *argv[])
+{
+	int opt;
 
-		w.draw();
+	while ((opt = getopt(argc, argv, "s:r:pT:c:S:w:l:m:i:e:C:zIg:R:")) != -1) {
+		switch (opt) {
+			case 's':
+				sim_rate = atoi(optarg);
+				break;
 
-		glPopMatrix();
+			case 'r':
+				render_rate = atoi(optarg);
+				break;
 
-#ifdef DUMP_FRAMES
-		if (cur_frame%2 == 0)
-			dump_frame(cur_frame/2);
+			case 'p':
+				show_profiler = true;
+				break;
 
-		++cur_frame;
-#endif
+			case 'T':
+				trace_path = optarg;
+				break;
 
-		SDL_GL_SwapBuffers();
+			case 'c':
+				capture_path = optarg;
+				break;
 
-		Uint32 now = SDL_GetTicks();
+			case 'S':
+				seed = strtoul(optarg, nullptr, 10);
+				break;
 
-		if (now < next_frame)
-			SDL_Delay(next_frame - now);
+			case 'w':
+				record_path = optarg;
+				break;
 
-		next_frame += FRAME_INTERVAL;
+			case 'l':
+				playback_path = optarg;
+				break;
+
+			case 'm':
+				solver.min_iterations = atoi(optarg);
+				break;
+
+			case 'i':
+				solver.max_iterations = atoi(optarg);
+				break;
+
+			case 'e':
+				solver.tolerance = atof(optarg);
+				break;
+
+			case 'C':
+				texture_cache_dir = optarg;
+				break;
+
+			case 'z':
+				compress_textures = true;
+				break;
+
+			case 'I':
+				instanced = true;
+				break;
+
+			case 'g':
+				if (!parse_size(optarg, window_width, window_height))
+					usage(argv[0]);
+				break;
+
+			case 'R':
+				if (!parse_size(optarg, resolution_width, resolution_height))
+					usage(argv[0]);
+				break;
+
+			default:
+				usage(argv[0]);
+		}
 	}
+
+	if (sim_rate <= 0 || render_rate < 0 || solver.min_iterations < 1 || solver.max_iterations < solver.min_iterations || solver.tolerance < 0)
+		usage(argv[0]);
 }
 
 int
 main(int argc, char *argv[])
 {
+	parse_options(argc, argv);
+
 	init();
 	game_loop();
 	tear_down();
@@ -0,0 +1,60 @@
+#pragma once
+
+namespace gge {
+
+// Column major, the way GL takes it, and only what 2D drawing needs.
+
+struct mat4
+{
+	static mat4 identity()
+	{
+		mat4 r {};
+		r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1;
+		return r;
+	}
+
+	// glOrtho
+
+	static mat4 ortho(float left, float right, float bottom, float top, float near = -1, float far = 1)
+	{
+		mat4 r = identity();
+
+		r.m[0] = 2/(right - left);
+		r.m[5] = 2/(top - bottom);
+		r.m[10] = -2/(far - near);
+
+		r.m[12] = -(right + left)/(right - left);
+		r.m[13] = -(top + bottom)/(top - bottom);
+		r.m[14] = -(far + near)/(far - near);
+
+		return r;
+	}
+
+	static mat4 translation(float x, float y)
+	{
+		mat4 r = identity();
+
+		r.m[12] = x;
+		r.m[13] = y;
+
+		return r;
+	}
+
+	mat4 operator*(const mat4& b) const
+	{
+		mat4 r {};
+
+		for (int i = 0; i < 4; i++) {
+			for (int j = 0; j < 4; j++) {
+				for (int k = 0; k < 4; k++)
+					r.m[4*j + i] += m[4*k + i]*b.m[4*j + k];
+			}
+		}
+
+		return r;
+	}
+
+	float m[16];
+};
+
+} // gge
@@ -0,0 +1,413 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "vec2.h"
+#include "kernels.h"
+#include "piece.h"
+#include "compressed_pixmap.h"
+
+// Times the inner pieces of the simulation and of texture generation one
+// at a time, where hell-bench only sees whole updates. Each benchmark runs
+// doubling numbers of iterations until one run takes at least the minimum
+// time, and reports the time per iteration of that run. The JSON output
+// uses the field names Google Benchmark writes, so its tools can compare
+// two runs.
+
+namespace {
+constexpr double DEFAULT_MIN_TIME_MS = 200;
+
+// enough vec2 for a loop over them to outweigh the loop
+constexpr size_t NUM_VECTORS = 1024;
+}
+
+static double min_time_ms = DEFAULT_MIN_TIME_MS;
+static const char *filter = nullptr;
+static const char *json_path = nullptr;
+
+// results go here so the compiler can't drop the work
+
+static volatile float sink;
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -f text  only run benchmarks with text in their name\n"
+		"  -m ms    least time a measured run takes (default %.0f)\n"
+		"  -j file  also write the results as JSON to file, - for stdout\n",
+		argv0, DEFAULT_MIN_TIME_MS);
+	exit(1);
+}
+
+static void
+parse_options(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:m:j:")) != -1) {
+		switch (opt) {
+			case 'f':
+				filter = optarg;
+				break;
+
+			case 'm':
+				min_time_ms = atof(optarg);
+				break;
+
+			case 'j':
+				json_path = optarg;
+				break;
+
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (min_time_ms <= 0)
+		usage(argv[0]);
+}
+
+//
+//  h a r n e s s
+//
+
+struct benchmark_result
+{
+	std::string name;
+	size_t iterations;
+	double real_ns; // per iteration
+	double cpu_ns;
+	size_t items; // per iteration
+};
+
+static std::vector<benchmark_result> results;
+
+// the table goes to stderr when the JSON goes to stdout
+static FILE *report = stdout;
+
+// fn(iterations) runs that many iterations of the benchmark, each handling
+// items of whatever the name says
+
+static void
+run(const std::string& name, size_t items, const std::function<void(size_t)>& fn)
+{
+	if (filter && name.find(filter) == std::string::npos)
+		return;
+
+	fn(1);
+
+	for (size_t iterations = 1; ; iterations *= 2) {
+		const auto start = std::chrono::steady_clock::now();
+		const std::clock_t cpu_start = std::clock();
+
+		fn(iterations);
+
+		const double real_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		const double cpu_ms = 1e3*(std::clock() - cpu_start)/CLOCKS_PER_SEC;
+
+		if (real_ms >= min_time_ms) {
+			results.push_back({ name, iterations, 1e6*real_ms/iterations, 1e6*cpu_ms/iterations, items });
+
+			const benchmark_result& r = results.back();
+			fprintf(report, "%-24s %12.1f ns %10.2f ns/item %12zu iterations\n", r.name.c_str(), r.real_ns, r.real_ns/items, r.iterations);
+			fflush(report);
+			break;
+		}
+	}
+}
+
+static bool
+write_json(const char *path)
+{
+	FILE *out = strcmp(path, "-") ? fopen(path, "w") : stdout;
+
+	if (!out)
+		return false;
+
+	char date[32];
+	const time_t now = time(nullptr);
+	strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"context\": {\n");
+	fprintf(out, "    \"date\": \"%s\",\n", date);
+	fprintf(out, "    \"min_time_ms\": %g\n", min_time_ms);
+	fprintf(out, "  },\n");
+	fprintf(out, "  \"benchmarks\": [\n");
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const benchmark_result& r = results[i];
+
+		fprintf(out, "    {\n");
+		fprintf(out, "      \"name\": \"%s\",\n", r.name.c_str());
+		fprintf(out, "      \"iterations\": %zu,\n", r.iterations);
+		fprintf(out, "      \"real_time\": %.3f,\n", r.real_ns);
+		fprintf(out, "      \"cpu_time\": %.3f,\n", r.cpu_ns);
+		fprintf(out, "      \"time_unit\": \"ns\",\n");
+		fprintf(out, "      \"items_per_second\": %.6g\n", 1e9*r.items/r.real_ns);
+		fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+
+	return out == stdout || fclose(out) == 0;
+}
+
+//
+//  v e c 2
+//
+
+static void
+bench_vec2()
+{
+	std::vector<vec2> v;
+
+	for (size_t i = 0; i < NUM_VECTORS; i++)
+		v.push_back(vec2(cosf(i) + 2, sinf(i) - 2)*(1 + i%7));
+
+	run("vec2/dot", NUM_VECTORS, [&] (size_t iterations) {
+		float s = 0;
+
+		for (size_t k = 0; k < iterations; k++) {
+			for (size_t i = 0; i + 1 < NUM_VECTORS; i++)
+				s += v[i].dot(v[i + 1]);
+		}
+
+		sink = s;
+	});
+
+	run("vec2/distance", NUM_VECTORS, [&] (size_t iterations) {
+		float s = 0;
+
+		for (size_t k = 0; k < iterations; k++) {
+			for (size_t i = 0; i + 1 < NUM_VECTORS; i++)
+				s += v[i].distance(v[i + 1]);
+		}
+
+		sink = s;
+	});
+
+	run("vec2/normalize", NUM_VECTORS, [&] (size_t iterations) {
+		float s = 0;
+
+		for (size_t k = 0; k < iterations; k++) {
+			for (auto& i : v) {
+				vec2 n = i;
+				s += n.normalize().x;
+			}
+		}
+
+		sink = s;
+	});
+}
+
+//
+//  c o l l i s i o n s
+//
+
+// Two single block pieces in a given relative placement, each collide()
+// starting from it again, with the contact cache kept from the last one as
+// it is between updates. Both are small enough that the reset costs little
+// next to the test itself.
+
+class collision_pair
+{
+public:
+	// b is turned by angle around its center and moved by offset from a
+
+	collision_pair(const piece_topology& topology, float angle, const vec2& offset)
+	: a_(topology, particles_)
+	, b_(topology, particles_)
+	{
+		const size_t n = topology.rest_positions.size();
+
+		vec2 center;
+
+		for (auto& i : topology.rest_positions)
+			center += i;
+
+		center *= 1.f/n;
+
+		const float c = cosf(angle), s = sinf(angle);
+
+		for (size_t i = 0; i < n; i++) {
+			const vec2 d = topology.rest_positions[i] - center;
+			particles_.x[n + i] = center.x + offset.x + c*d.x - s*d.y;
+			particles_.y[n + i] = center.y + offset.y + s*d.x + c*d.y;
+		}
+
+		b_.move(vec2());
+
+		initial_ = particles_;
+	}
+
+	void collide()
+	{
+		particles_.x = initial_.x;
+		particles_.y = initial_.y;
+
+		a_.move(vec2());
+		b_.move(vec2());
+
+		a_.collide(b_, cache_);
+	}
+
+	// true if the last collide() pushed the pieces apart
+
+	bool pushed() const
+	{ return particles_.x != initial_.x || particles_.y != initial_.y; }
+
+private:
+	particle_store particles_; // before the pieces, which address it
+	piece a_, b_;
+	particle_store initial_;
+	contact_cache cache_;
+};
+
+static void
+bench_collisions()
+{
+	piece_factory& factory = piece_factory::get_instance();
+
+	const piece_topology& whole = factory.get_topology(0);
+	const piece_topology& block = factory.get_fragment(0, whole.blocks & -whole.blocks);
+
+	// a diamond off one corner of the square: the boxes overlap, but one of
+	// the diamond's edge normals separates them
+	collision_pair separated(block, .25*M_PI, vec2(BLOCK_SIZE, BLOCK_SIZE));
+
+	// side by side, sharing an edge
+	collision_pair touching(block, 0, vec2(BLOCK_SIZE, 0));
+
+	// a quarter of a block into each other
+	collision_pair overlapping(block, 0, vec2(.75f*BLOCK_SIZE, .25f*BLOCK_SIZE));
+
+	separated.collide();
+	overlapping.collide();
+
+	if (separated.pushed() || !overlapping.pushed()) {
+		fprintf(stderr, "collision cases don't collide as they should\n");
+		exit(1);
+	}
+
+	auto run_pair = [] (const char *name, collision_pair& pair) {
+		run(name, 1, [&] (size_t iterations) {
+			for (size_t i = 0; i < iterations; i++)
+				pair.collide();
+		});
+	};
+
+	run_pair("collide/separated", separated);
+	run_pair("collide/touching", touching);
+	run_pair("collide/overlapping", overlapping);
+}
+
+//
+//  s p r i n g s
+//
+
+static void
+bench_springs()
+{
+	const piece_factory& factory = piece_factory::get_instance();
+
+	for (size_t type = 0; type < factory.get_num_types(); type++) {
+		const piece_topology& t = factory.get_topology(type);
+
+		// stretched a little, so every pass has something to do
+		std::vector<float> x, y;
+
+		for (auto& i : t.rest_positions) {
+			x.push_back(1.05f*i.x);
+			y.push_back(1.05f*i.y);
+		}
+
+		// items are springs
+		const std::string suffix = "/type" + std::to_string(type);
+
+		run("springs" + suffix, t.springs.size(), [&] (size_t iterations) {
+			float s = 0;
+
+			for (size_t i = 0; i < iterations; i++)
+				s += kernels::relax_springs(&x[0], &y[0], &t.springs[0], &t.color_offsets[0], t.color_offsets.size() - 1);
+
+			sink = s;
+		});
+
+		if (t.relax_springs_fixed) {
+			run("springs_fixed" + suffix, t.springs.size(), [&] (size_t iterations) {
+				float s = 0;
+
+				for (size_t i = 0; i < iterations; i++)
+					s += t.relax_springs_fixed(&x[0], &y[0]);
+
+				sink = s;
+			});
+		}
+	}
+}
+
+//
+//  t e x t u r e s
+//
+
+// what texture loading costs on the CPU side: making the atlas and, with
+// -z, compressing it; the upload itself needs a GL context
+
+static void
+bench_textures()
+{
+	const piece_atlas& atlas = piece_factory::get_instance().get_atlas();
+
+	const size_t num_pixels = atlas.get_width()*atlas.get_height();
+
+	run("atlas/make_pixmap", num_pixels, [&] (size_t iterations) {
+		for (size_t i = 0; i < iterations; i++)
+			sink = atlas.make_pixmap().data[0];
+	});
+
+	const auto pm = atlas.make_pixmap();
+
+	run("atlas/compress_dxt1", num_pixels, [&] (size_t iterations) {
+		for (size_t i = 0; i < iterations; i++)
+			sink = gge::compress(pm, gge::compressed_format::DXT1).data[0];
+	});
+
+	run("atlas/compress_etc2", num_pixels, [&] (size_t iterations) {
+		for (size_t i = 0; i < iterations; i++)
+			sink = gge::compress(pm, gge::compressed_format::ETC2_RGB8).data[0];
+	});
+}
+
+int
+main(int argc, char *argv[])
+{
+	parse_options(argc, argv);
+
+	if (json_path && !strcmp(json_path, "-"))
+		report = stderr;
+
+	bench_vec2();
+	bench_collisions();
+	bench_springs();
+	bench_textures();
+
+	if (json_path && !write_json(json_path)) {
+		fprintf(stderr, "failed to write %s\n", json_path);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <new>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+// Objects allocated in fixed size chunks that never move, so pointers and
+// handles stay valid while the pool grows. Slots of destroyed objects are
+// recycled; a handle carries the slot's generation, so a handle to a
+// destroyed object doesn't resolve to whatever took its slot.
+//
+// Slots are numbered in allocation order; iterate with get_num_slots() and
+// is_alive().
+
+template <typename T, size_t ChunkSize = 64>
+class object_pool
+{
+public:
+	struct handle
+	{
+		uint32_t index;
+		uint32_t generation;
+	};
+
+	object_pool()
+	: size_(0)
+	{ }
+
+	~object_pool()
+	{ clear(); }
+
+	template <typename... Args>
+	handle create(Args&&... args)
+	{
+		uint32_t index;
+
+		if (!free_.empty()) {
+			index = free_.back();
+			free_.pop_back();
+		} else {
+			index = generations_.size();
+
+			if (index%ChunkSize == 0)
+				chunks_.emplace_back(new chunk);
+
+			generations_.push_back(0);
+			alive_.push_back(false);
+		}
+
+		new (get_storage(index)) T(std::forward<Args>(args)...);
+
+		alive_[index] = true;
+		++size_;
+
+		return { index, generations_[index] };
+	}
+
+	void destroy(handle h)
+	{
+		if (!get(h))
+			return;
+
+		(*this)[h.index].~T();
+
+		alive_[h.index] = false;
+		++generations_[h.index];
+		free_.push_back(h.index);
+		--size_;
+	}
+
+	void clear()
+	{
+		for (size_t i = 0; i < get_num_slots(); i++) {
+			if (alive_[i])
+				(*this)[i].~T();
+		}
+
+		chunks_.clear();
+		generations_.clear();
+		alive_.clear();
+		free_.clear();
+		size_ = 0;
+	}
+
+	// null if the object was destroyed
+
+	T *get(handle h)
+	{ return h.index < get_num_slots() && alive_[h.index] && generations_[h.index] == h.generation ? &(*this)[h.index] : nullptr; }
+
+	const T *get(handle h) const
+	{ return const_cast<object_pool *>(this)->get(h); }
+
+	T& operator[](size_t index)
+	{
+		assert(alive_[index]);
+		return *static_cast<T *>(get_storage(index));
+	}
+
+	const T& operator[](size_t index) const
+	{ return const_cast<object_pool&>(*this)[index]; }
+
+	bool is_alive(size_t index) const
+	{ return alive_[index]; }
+
+	handle get_handle(size_t index) const
+	{
+		assert(alive_[index]);
+		return { static_cast<uint32_t>(index), generations_[index] };
+	}
+
+	template <typename F>
+	void for_each(F fn)
+	{
+		for (size_t i = 0; i < get_num_slots(); i++) {
+			if (alive_[i])
+				fn((*this)[i]);
+		}
+	}
+
+	template <typename F>
+	void for_each(F fn) const
+	{
+		for (size_t i = 0; i < get_num_slots(); i++) {
+			if (alive_[i])
+				fn((*this)[i]);
+		}
+	}
+
+	// number of live objects
+
+	size_t size() const
+	{ return size_; }
+
+	bool empty() const
+	{ return size_ == 0; }
+
+	// one past the highest slot ever used
+
+	size_t get_num_slots() const
+	{ return generations_.size(); }
+
+private:
+	struct chunk
+	{
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[ChunkSize];
+	};
+
+	void *get_storage(size_t index)
+	{ return &chunks_[index/ChunkSize]->slots[index%ChunkSize]; }
+
+	std::vector<std::unique_ptr<chunk>> chunks_;
+	std::vector<uint32_t> generations_;
+	std::vector<uint8_t> alive_;
+	std::vector<uint32_t> free_;
+	size_t size_;
+
+	object_pool(const object_pool&) = delete;
+	object_pool& operator=(const object_pool&) = delete;
+};
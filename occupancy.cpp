@@ -0,0 +1,128 @@
+#include <algorithm>
+
+#include <cmath>
+
+#include "occupancy.h"
+
+namespace {
+
+float
+cross(const vec2& a, const vec2& b, const vec2& p)
+{
+	return (b.x - a.x)*(p.y - a.y) - (b.y - a.y)*(p.x - a.x);
+}
+
+bool
+is_inside(const vec2 *corners, const vec2& p)
+{
+	bool negative = false, positive = false;
+
+	for (int i = 0; i < 4; i++) {
+		const float c = cross(corners[i], corners[(i + 1)%4], p);
+
+		negative |= c < 0;
+		positive |= c > 0;
+	}
+
+	return !(negative && positive);
+}
+
+}
+
+occupancy_grid::occupancy_grid(const container& walls, float cell_size, int cells_per_row, float wall_gap)
+: cell_size_(cell_size)
+, cells_per_row_(cells_per_row)
+{
+	const std::vector<vec2>& outline = walls.get_outline();
+
+	float bottom = walls.get_top();
+	float left = walls.get_left(), right = walls.get_right();
+
+	for (auto& i : outline) {
+		bottom = std::min(bottom, i.y);
+		left = std::min(left, i.x);
+		right = std::max(right, i.x);
+	}
+
+	origin_ = vec2(left, bottom);
+
+	const float row_height = cells_per_row*cell_size;
+	const int num_rows = ceilf((walls.get_top() - bottom)/row_height);
+
+	cols_ = ceilf((right - left)/cell_size);
+
+	counts_.resize(cols_*cells_per_row*num_rows);
+	covered_.resize(counts_.size());
+	row_cells_.resize(num_rows);
+
+	for (int i = 0; i < cells_per_row*num_rows; i++) {
+		for (int j = 0; j < cols_; j++) {
+			const vec2 center = origin_ + vec2(j + .5f, i + .5f)*cell_size;
+
+			if (walls.get_distance(center) < -wall_gap) {
+				counts_[i*cols_ + j] = 1;
+				++row_cells_[i/cells_per_row];
+			}
+		}
+	}
+}
+
+void
+occupancy_grid::clear()
+{
+	std::fill(covered_.begin(), covered_.end(), 0);
+}
+
+void
+occupancy_grid::add_quad(const vec2 *corners)
+{
+	vec2 lo = corners[0], hi = corners[0];
+
+	for (int i = 1; i < 4; i++) {
+		lo.x = std::min(lo.x, corners[i].x);
+		lo.y = std::min(lo.y, corners[i].y);
+		hi.x = std::max(hi.x, corners[i].x);
+		hi.y = std::max(hi.y, corners[i].y);
+	}
+
+	// cells with centers in the box
+
+	const int num_cell_rows = cells_per_row_*get_num_rows();
+
+	const int j0 = std::max(static_cast<int>(ceilf((lo.x - origin_.x)/cell_size_ - .5f)), 0);
+	const int j1 = std::min(static_cast<int>(floorf((hi.x - origin_.x)/cell_size_ - .5f)), cols_ - 1);
+	const int i0 = std::max(static_cast<int>(ceilf((lo.y - origin_.y)/cell_size_ - .5f)), 0);
+	const int i1 = std::min(static_cast<int>(floorf((hi.y - origin_.y)/cell_size_ - .5f)), num_cell_rows - 1);
+
+	for (int i = i0; i <= i1; i++) {
+		for (int j = j0; j <= j1; j++) {
+			if (is_inside(corners, origin_ + vec2(j + .5f, i + .5f)*cell_size_))
+				covered_[i*cols_ + j] = 1;
+		}
+	}
+}
+
+int
+occupancy_grid::get_row(float y) const
+{
+	const float row = floorf((y - origin_.y)/(cells_per_row_*cell_size_));
+
+	return row >= 0 && row < get_num_rows() ? static_cast<int>(row) : -1;
+}
+
+float
+occupancy_grid::get_fill(size_t row) const
+{
+	if (row_cells_[row] == 0)
+		return 0;
+
+	const size_t first = row*cells_per_row_*cols_;
+	const size_t last = first + cells_per_row_*cols_;
+
+	int covered = 0;
+
+	for (size_t i = first; i < last; i++)
+		covered += counts_[i] & covered_[i];
+
+	return static_cast<float>(covered)/row_cells_[row];
+}
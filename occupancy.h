@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vec2.h"
+#include "container.h"
+
+// The inside of a container rasterized into square cells, grouped in rows
+// cells_per_row cells high from the bottom of the outline up to the top,
+// for telling how much of each row is covered by quads. Cells closer to the
+// walls than wall_gap don't count: square blocks never reach into the
+// curved parts.
+
+class occupancy_grid
+{
+public:
+	occupancy_grid(const container& walls, float cell_size, int cells_per_row, float wall_gap);
+
+	void clear();
+
+	// marks the cells with centers inside a convex quad, corners in order
+	// around it either way
+
+	void add_quad(const vec2 *corners);
+
+	size_t get_num_rows() const
+	{ return row_cells_.size(); }
+
+	// the row y is in, -1 if it's below or above every row
+
+	int get_row(float y) const;
+
+	float get_row_bottom(size_t row) const
+	{ return origin_.y + row*cells_per_row_*cell_size_; }
+
+	// fraction of the cells of a row that count and are covered
+
+	float get_fill(size_t row) const;
+
+private:
+	vec2 origin_;
+	float cell_size_;
+	int cols_, cells_per_row_;
+	std::vector<uint8_t> counts_; // cells_per_row_*get_num_rows() rows of cols_
+	std::vector<uint8_t> covered_; // same
+	std::vector<int> row_cells_; // number of cells that count in each row
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "vec2.h"
+
+// Verlet particles for every piece in the world, in structure-of-arrays
+// layout. Each piece owns a contiguous range and addresses its particles
+// by index relative to the start of that range.
+
+struct particle_store
+{
+	size_t add(const vec2& p)
+	{
+		x.push_back(p.x);
+		y.push_back(p.y);
+		px.push_back(p.x);
+		py.push_back(p.y);
+		return x.size() - 1;
+	}
+
+	void reserve(size_t n)
+	{
+		x.reserve(n);
+		y.reserve(n);
+		px.reserve(n);
+		py.reserve(n);
+	}
+
+	size_t size() const
+	{ return x.size(); }
+
+	vec2 get_position(size_t i) const
+	{ return vec2(x[i], y[i]); }
+
+	std::vector<float> x, y;	// position
+	std::vector<float> px, py;	// previous position
+};
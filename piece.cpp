@@ -0,0 +1,737 @@
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+
+#include "profiler.h"
+#include "piece.h"
+
+namespace {
+constexpr auto GRAVITY = 1.f;
+constexpr auto DAMPING = .75f;
+constexpr auto FRICTION = .6f;
+
+// a piece goes to sleep when no particle moved more than SLEEP_MOTION in
+// any update, and its centroid drifted less than SLEEP_DRIFT, over the last
+// SLEEP_UPDATES updates
+
+constexpr auto SLEEP_MOTION = 1.f;
+constexpr auto SLEEP_DRIFT = 1.f;
+constexpr auto SLEEP_UPDATES = 30;
+
+// axes 0 to 3 are the normals of the first quad's edges, 4 to 7 those of
+// the second's
+
+constexpr auto NUM_SAT_AXES = 8;
+constexpr auto NO_AXIS = -1;
+
+class quad_collision
+{
+public:
+	// n0 are the edge normals of t0; those of t1 are worked out when needed
+
+	quad_collision(const vec2 *t0, const vec2 *n0, const vec2 *t1)
+	: t0_(t0), n0_(n0), t1_(t1)
+	, separating_axis_(NO_AXIS)
+	, early_out_(false)
+	{ }
+
+	// first_axis, if not NO_AXIS, is tried before the rest; the result
+	// doesn't depend on it
+
+	bool operator()(int first_axis);
+
+	const vec2& push_vector() const
+	{ return push_vector_; }
+
+	// the axis that separates the quads, NO_AXIS if they collide
+
+	int separating_axis() const
+	{ return separating_axis_; }
+
+	// true if first_axis separated the quads
+
+	bool early_out() const
+	{ return early_out_; }
+
+private:
+	// extents of both quads along an axis
+
+	struct projection
+	{
+		std::pair<float, float> s0, s1;
+	};
+
+	vec2 get_axis(int axis) const;
+
+	// true if the axis separates the quads
+
+	bool project(const vec2& normal, projection& p) const;
+
+	template <bool First>
+	void update_push_vector(vec2 normal, const projection& p);
+
+	const vec2 *t0_, *n0_, *t1_;
+	vec2 push_vector_;
+	int separating_axis_;
+	bool early_out_;
+};
+
+constexpr auto SAT_EPSILON = 1e-5f;
+
+// shapes of the built-in patterns, worked out at compile time
+
+template <size_t Type>
+struct pattern_shape
+{
+	static constexpr piece_shape value = make_piece_shape(PIECE_PATTERNS[Type], BLOCK_SIZE);
+};
+
+template <size_t Type>
+constexpr piece_shape pattern_shape<Type>::value;
+
+// Springs of a built-in pattern relaxed one after the other with constant
+// particle indices and rest lengths. In color order, so the result is the
+// same as kernels::relax_springs.
+
+template <size_t Type, size_t Spring>
+inline float
+relax_pattern_spring(float *x, float *y)
+{
+	constexpr spring s = pattern_shape<Type>::value.springs[Spring];
+	return kernels::relax_spring(x, y, s);
+}
+
+template <size_t Type, size_t... Springs>
+inline float
+relax_pattern_springs(float *x, float *y, std::index_sequence<Springs...>)
+{
+	float stretch = 0;
+
+	const int expand[] { 0, (stretch = std::max(stretch, relax_pattern_spring<Type, Springs>(x, y)), 0)... };
+	(void)expand;
+
+	return stretch;
+}
+
+template <size_t Type>
+float
+relax_pattern(float *x, float *y)
+{
+	return relax_pattern_springs<Type>(x, y, std::make_index_sequence<pattern_shape<Type>::value.num_springs>());
+}
+
+template <size_t... Types>
+void
+add_pattern_topologies(std::vector<piece_topology>& topologies, const piece_atlas& atlas, std::index_sequence<Types...>)
+{
+	const int expand[] {
+		0,
+		(topologies.emplace_back(
+			Types,
+			pattern_shape<Types>::value,
+			PIECE_PATTERNS[Types].color,
+			atlas.get_origin(Types),
+			atlas.get_block_size(),
+			relax_pattern<Types>), 0)... };
+	(void)expand;
+}
+}
+
+//
+//  q u a d
+//
+
+aabb
+quad::get_bounding_box(const float *x, const float *y) const
+{
+	aabb box;
+
+	box.min.x = std::min(std::min(x[p0], x[p1]), std::min(x[p2], x[p3]));
+	box.min.y = std::min(std::min(y[p0], y[p1]), std::min(y[p2], y[p3]));
+
+	box.max.x = std::max(std::max(x[p0], x[p1]), std::max(x[p2], x[p3]));
+	box.max.y = std::max(std::max(y[p0], y[p1]), std::max(y[p2], y[p3]));
+
+	return box;
+}
+
+//
+//  q u a d _ c o l l i s i o n
+//
+
+static std::pair<float, float>
+project_quad_to_axis(const vec2& dir, const vec2 *t)
+{
+	float t0 = dir.dot(t[0]);
+	float t1 = dir.dot(t[1]);
+	float t2 = dir.dot(t[2]);
+	float t3 = dir.dot(t[3]);
+
+	float min = std::min(t0, std::min(t1, std::min(t2, t3)));
+	float max = std::max(t0, std::max(t1, std::max(t2, t3)));
+
+	return std::make_pair(min, max);
+}
+
+static vec2
+get_edge_normal(const vec2& from, const vec2& to)
+{
+	return vec2(-(to.y - from.y), to.x - from.x).normalize();
+}
+
+static void
+get_edge_normals(const vec2 *t, vec2 *normals)
+{
+	for (int i = 0; i < 4; i++)
+		normals[i] = get_edge_normal(t[i], t[(i + 1)%4]);
+}
+
+vec2
+quad_collision::get_axis(int axis) const
+{
+	if (axis < 4)
+		return n0_[axis];
+
+	return get_edge_normal(t1_[axis - 4], t1_[(axis - 3)%4]);
+}
+
+bool
+quad_collision::project(const vec2& normal, projection& p) const
+{
+	p.s0 = project_quad_to_axis(normal, t0_);
+	p.s1 = project_quad_to_axis(normal, t1_);
+
+	return p.s0.second < p.s1.first + SAT_EPSILON || p.s1.second < p.s0.first + SAT_EPSILON;
+}
+
+template <bool First>
+void
+quad_collision::update_push_vector(vec2 normal, const projection& p)
+{
+	float push_length;
+
+	if (p.s0.second - p.s1.first < p.s1.second - p.s0.first) {
+		push_length = p.s0.second - p.s1.first;
+	} else {
+		normal = -normal;
+		push_length = p.s1.second - p.s0.first;
+	}
+
+	push_length *= .5*FRICTION;
+
+	if (First || push_length*push_length < push_vector_.length_squared())
+		push_vector_ = normal*(push_length/normal.length());
+}
+
+bool
+quad_collision::operator()(int first_axis)
+{
+	// quads that touch at all overlap on every axis, and the push vector
+	// takes all of them in order; only a miss can be cut short
+
+	vec2 first_normal;
+	projection first;
+
+	if (first_axis != NO_AXIS) {
+		first_normal = get_axis(first_axis);
+
+		if (project(first_normal, first)) {
+			separating_axis_ = first_axis;
+			early_out_ = true;
+			return false;
+		}
+	}
+
+	for (int i = 0; i < NUM_SAT_AXES; i++) {
+		vec2 normal;
+		projection p;
+
+		if (i == first_axis) {
+			normal = first_normal;
+			p = first;
+		} else {
+			normal = get_axis(i);
+
+			if (project(normal, p)) {
+				separating_axis_ = i;
+				return false;
+			}
+		}
+
+		if (i == 0)
+			update_push_vector<true>(normal, p);
+		else
+			update_push_vector<false>(normal, p);
+	}
+
+	return true;
+}
+
+//
+//  p i e c e _ t o p o l o g y
+//
+
+piece_topology::piece_topology(int type, const piece_shape& shape, const rgb& color, const vec2& uv_origin, const vec2& uv_block_size, relax_fn relax_springs_fixed)
+: type(type)
+, blocks(0)
+, color(color)
+, springs(shape.springs, shape.springs + shape.num_springs)
+, color_offsets(shape.color_offsets, shape.color_offsets + shape.num_colors + 1)
+, relax_springs_fixed(relax_springs_fixed)
+{
+	for (size_t i = 0; i < shape.num_bodies; i++)
+		rest_positions.push_back(vec2(shape.bodies[i].col*BLOCK_SIZE, shape.bodies[i].row*BLOCK_SIZE));
+
+	const float du = uv_block_size.x;
+	const float dv = uv_block_size.y;
+
+	uvs.resize(rest_positions.size());
+
+	for (size_t i = 0; i < shape.num_blocks; i++) {
+		const piece_shape::block& b = shape.blocks[i];
+
+		const float u = uv_origin.x + du*b.col;
+		const float v = uv_origin.y + dv*b.row;
+
+		quads.push_back(quad{b.p0, b.p1, b.p2, b.p3});
+
+		// a body shared by neighbouring blocks is the same corner of the
+		// pattern to each of them, so it gets the same texture coordinates
+
+		uvs[b.p0] = vec2(u, v);
+		uvs[b.p1] = vec2(u + du, v);
+		uvs[b.p2] = vec2(u + du, v + dv);
+		uvs[b.p3] = vec2(u, v + dv);
+
+		const int block = b.row*MAX_PIECE_COLS + b.col;
+		quad_blocks.push_back(block);
+		blocks |= 1u << block;
+	}
+}
+
+//
+//  p i e c e
+//
+
+piece::piece(const piece_topology& topology, particle_store& particles)
+: topology_(&topology)
+, particles_(&particles)
+, first_particle_(particles.size())
+, motion_squared_(0)
+, solver_error_(0)
+, idle_updates_(0)
+, sleeping_(false)
+{
+	assert(topology.quads.size() <= MAX_PIECE_QUADS);
+
+	for (auto& i : topology.rest_positions)
+		particles.add(i);
+
+	update_bounding_box();
+}
+
+void
+piece::update_positions()
+{
+	kernels::integrate(
+		get_x(), get_y(),
+		&particles_->px[first_particle_], &particles_->py[first_particle_],
+		get_num_particles(),
+		DAMPING, GRAVITY);
+
+	update_bounding_box();
+}
+
+void
+piece::relax_springs()
+{
+	const piece_topology& t = *topology_;
+
+	if (t.relax_springs_fixed)
+		solver_error_ = t.relax_springs_fixed(get_x(), get_y());
+	else
+		solver_error_ = kernels::relax_springs(get_x(), get_y(), &t.springs[0], &t.color_offsets[0], t.color_offsets.size() - 1);
+}
+
+void
+piece::constrain_to_walls(const container& walls)
+{
+	walls.constrain(get_x(), get_y(), get_num_particles(), FRICTION);
+
+	update_bounding_box();
+}
+
+void
+piece::move(const vec2& p)
+{
+	float *x = get_x();
+	float *y = get_y();
+	float *px = &particles_->px[first_particle_];
+	float *py = &particles_->py[first_particle_];
+
+	for (size_t i = 0; i < get_num_particles(); i++) {
+		px[i] = x[i] += p.x;
+		py[i] = y[i] += p.y;
+	}
+
+	update_bounding_box();
+}
+
+void
+piece::copy_bodies(const piece& whole)
+{
+	const std::vector<vec2>& rest = topology_->rest_positions;
+	const std::vector<vec2>& whole_rest = whole.topology_->rest_positions;
+
+	float *x = get_x();
+	float *y = get_y();
+	float *px = &particles_->px[first_particle_];
+	float *py = &particles_->py[first_particle_];
+
+	const float *wx = whole.get_x();
+	const float *wy = whole.get_y();
+	const float *wpx = &whole.particles_->px[whole.first_particle_];
+	const float *wpy = &whole.particles_->py[whole.first_particle_];
+
+	for (size_t i = 0; i < rest.size(); i++) {
+		auto is_same_body = [&] (const vec2& p) { return p.x == rest[i].x && p.y == rest[i].y; };
+
+		const size_t j = std::find_if(whole_rest.begin(), whole_rest.end(), is_same_body) - whole_rest.begin();
+		assert(j < whole_rest.size());
+
+		x[i] = wx[j];
+		y[i] = wy[j];
+		px[i] = wpx[j];
+		py[i] = wpy[j];
+	}
+
+	update_bounding_box();
+}
+
+void
+piece::move_particles(particle_store& to)
+{
+	const size_t first = to.size();
+	const size_t last = first_particle_ + get_num_particles();
+
+	to.x.insert(to.x.end(), &particles_->x[first_particle_], &particles_->x[last]);
+	to.y.insert(to.y.end(), &particles_->y[first_particle_], &particles_->y[last]);
+	to.px.insert(to.px.end(), &particles_->px[first_particle_], &particles_->px[last]);
+	to.py.insert(to.py.end(), &particles_->py[first_particle_], &particles_->py[last]);
+
+	first_particle_ = first;
+}
+
+float
+piece::get_step_length() const
+{
+	const float *x = get_x();
+	const float *y = get_y();
+	const float *px = &particles_->px[first_particle_];
+	const float *py = &particles_->py[first_particle_];
+
+	float step_squared = 0;
+
+	for (size_t i = 0; i < get_num_particles(); i++) {
+		const float dx = x[i] - px[i];
+		const float dy = y[i] - py[i];
+		step_squared = std::max(step_squared, dx*dx + dy*dy);
+	}
+
+	return sqrtf(step_squared);
+}
+
+void
+piece::update_sleep_state()
+{
+	const float *x = get_x();
+	const float *y = get_y();
+	const float *px = &particles_->px[first_particle_];
+	const float *py = &particles_->py[first_particle_];
+
+	motion_squared_ = 0;
+
+	for (size_t i = 0; i < get_num_particles(); i++) {
+		const float dx = x[i] - px[i];
+		const float dy = y[i] - py[i];
+		motion_squared_ = std::max(motion_squared_, dx*dx + dy*dy);
+	}
+
+	if (motion_squared_ > SLEEP_MOTION*SLEEP_MOTION) {
+		idle_updates_ = 0;
+		return;
+	}
+
+	if (idle_updates_ == 0)
+		idle_centroid_ = get_centroid();
+
+	if (++idle_updates_ < SLEEP_UPDATES)
+		return;
+
+	if (get_centroid().distance(idle_centroid_) > SLEEP_DRIFT) {
+		idle_updates_ = 0;
+		return;
+	}
+
+	// drop whatever velocity is left so it doesn't come back on wake
+
+	std::copy(x, x + get_num_particles(), &particles_->px[first_particle_]);
+	std::copy(y, y + get_num_particles(), &particles_->py[first_particle_]);
+
+	motion_squared_ = 0;
+	sleeping_ = true;
+}
+
+void
+piece::wake()
+{
+	sleeping_ = false;
+	idle_updates_ = 0;
+}
+
+void
+piece::get_corners(const quad& q, vec2 *corners) const
+{
+	const float *x = get_x();
+	const float *y = get_y();
+
+	corners[0] = vec2(x[q.p0], y[q.p0]);
+	corners[1] = vec2(x[q.p1], y[q.p1]);
+	corners[2] = vec2(x[q.p2], y[q.p2]);
+	corners[3] = vec2(x[q.p3], y[q.p3]);
+}
+
+void
+piece::push_quad(const quad& q, const vec2& v)
+{
+	float *x = get_x();
+	float *y = get_y();
+
+	x[q.p0] += v.x; y[q.p0] += v.y;
+	x[q.p1] += v.x; y[q.p1] += v.y;
+	x[q.p2] += v.x; y[q.p2] += v.y;
+	x[q.p3] += v.x; y[q.p3] += v.y;
+}
+
+void
+piece::collide(piece& other, contact_cache& cache)
+{
+	profiler& prof = profiler::get_instance();
+
+	prof.add_count(profile_counter::PAIRS_TESTED, 1);
+
+	// bounding box
+
+	if (max_pos_.x < other.min_pos_.x)
+		return;
+
+	if (other.max_pos_.x < min_pos_.x)
+		return;
+
+	if (max_pos_.y < other.min_pos_.y)
+		return;
+
+	if (other.max_pos_.y < min_pos_.y)
+		return;
+
+	// a sleeping piece doesn't move, so the other one takes the whole push
+
+	const float w0 = sleeping_ ? 0 : other.sleeping_ ? 2 : 1;
+	const float w1 = other.sleeping_ ? 0 : sleeping_ ? 2 : 1;
+
+	// quads
+
+	vec2 c0[4], c1[4];
+	vec2 n0[4];
+
+	size_t sat_tests = 0, early_outs = 0, contacts = 0;
+
+	const std::vector<quad>& quads0 = topology_->quads;
+	const std::vector<quad>& quads1 = other.topology_->quads;
+
+	for (size_t i = 0; i < quads0.size(); i++) {
+		const quad& q0 = quads0[i];
+		const aabb& box0 = quad_boxes_[i];
+
+		if (!box0.overlaps(other.get_bounding_box()))
+			continue;
+
+		get_corners(q0, c0);
+
+		// worked out on the first test that needs them
+
+		bool have_normals = false;
+
+		for (size_t j = 0; j < quads1.size(); j++) {
+			const quad& q1 = quads1[j];
+
+			if (!box0.overlaps(other.quad_boxes_[j]))
+				continue;
+
+			other.get_corners(q1, c1);
+
+			if (!have_normals) {
+				get_edge_normals(c0, n0);
+				have_normals = true;
+			}
+
+			quad_collision collision(c0, n0, c1);
+			++sat_tests;
+
+			uint8_t& cached = cache.axes[i][j];
+
+			// quads touching last time most likely still are, and for
+			// those the early test is wasted
+
+			const bool collided = collision(cached == contact_cache::TOUCHING ? NO_AXIS : cached);
+
+			cached = collided ? contact_cache::TOUCHING : collision.separating_axis();
+
+			if (collision.early_out())
+				++early_outs;
+
+			if (collided) {
+				++contacts;
+
+				const float push = collision.push_vector().length();
+
+				if (w0 != 0) {
+					push_quad(q0, -collision.push_vector()*w0);
+					solver_error_ = std::max(solver_error_, push*w0);
+				}
+
+				if (w1 != 0) {
+					other.push_quad(q1, collision.push_vector()*w1);
+					other.solver_error_ = std::max(other.solver_error_, push*w1);
+				}
+
+				// a push also moves the corners shared with neighboring quads,
+				// so refresh every quad box of both pieces
+
+				update_bounding_box();
+				other.update_bounding_box();
+
+				get_corners(q0, c0);
+				have_normals = false;
+			}
+		}
+	}
+
+	prof.add_count(profile_counter::SAT_TESTS, sat_tests);
+	prof.add_count(profile_counter::EARLY_OUTS, early_outs);
+	prof.add_count(profile_counter::CONTACTS, contacts);
+}
+
+void
+piece::write_states(float *prev_xy, float *xy) const
+{
+	const float *x = get_x();
+	const float *y = get_y();
+	const float *px = &particles_->px[first_particle_];
+	const float *py = &particles_->py[first_particle_];
+
+	for (size_t i = 0; i < get_num_particles(); i++) {
+		*prev_xy++ = px[i];
+		*prev_xy++ = py[i];
+		*xy++ = x[i];
+		*xy++ = y[i];
+	}
+}
+
+vec2
+piece::get_centroid() const
+{
+	const float *x = get_x();
+	const float *y = get_y();
+
+	vec2 c;
+
+	for (size_t i = 0; i < get_num_particles(); i++)
+		c += vec2(x[i], y[i]);
+
+	return c*(1.f/get_num_particles());
+}
+
+void
+piece::update_bounding_box()
+{
+	const std::vector<quad>& quads = topology_->quads;
+
+	assert(!quads.empty());
+
+	const float *x = get_x();
+	const float *y = get_y();
+
+	// every body is a corner of some quad, so the union of the quad boxes
+	// is the piece box
+
+	for (size_t i = 0; i < quads.size(); i++)
+		quad_boxes_[i] = quads[i].get_bounding_box(x, y);
+
+	min_pos_ = quad_boxes_[0].min;
+	max_pos_ = quad_boxes_[0].max;
+
+	std::for_each(
+		&quad_boxes_[1],
+		&quad_boxes_[quads.size()],
+		[this] (const aabb& box) {
+			min_pos_.x = std::min(min_pos_.x, box.min.x);
+			max_pos_.x = std::max(max_pos_.x, box.max.x);
+
+			min_pos_.y = std::min(min_pos_.y, box.min.y);
+			max_pos_.y = std::max(max_pos_.y, box.max.y);
+		});
+}
+
+//
+//  p i e c e _ f a c t o r y
+//
+
+piece_factory&
+piece_factory::get_instance()
+{
+	static piece_factory instance;
+	return instance;
+}
+
+piece_factory::piece_factory()
+: atlas_(PIECE_PATTERNS, NUM_PIECE_PATTERNS)
+{
+	topologies_.reserve(NUM_PIECE_PATTERNS);
+	add_pattern_topologies(topologies_, atlas_, std::make_index_sequence<NUM_PIECE_PATTERNS>());
+}
+
+const piece_topology&
+piece_factory::get_fragment(int type, uint32_t blocks)
+{
+	std::lock_guard<std::mutex> lock(fragments_mutex_);
+
+	const uint32_t key = static_cast<uint32_t>(type) << MAX_PIECE_QUADS | blocks;
+
+	auto it = fragments_.find(key);
+
+	if (it == fragments_.end()) {
+		piece_pattern pattern = PIECE_PATTERNS[type];
+
+		for (int i = 0; i < MAX_PIECE_ROWS; i++) {
+			for (int j = 0; j < MAX_PIECE_COLS; j++)
+				pattern.pattern[i][j] = blocks & (1u << (i*MAX_PIECE_COLS + j)) ? '#' : ' ';
+		}
+
+		it = fragments_.emplace(
+			std::piecewise_construct,
+			std::forward_as_tuple(key),
+			std::forward_as_tuple(
+				type,
+				make_piece_shape(pattern, BLOCK_SIZE),
+				pattern.color,
+				atlas_.get_origin(type),
+				atlas_.get_block_size())).first;
+	}
+
+	return it->second;
+}
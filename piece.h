@@ -0,0 +1,225 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+
+#include "vec2.h"
+#include "particles.h"
+#include "kernels.h"
+#include "broad_phase.h"
+#include "piece_pattern.h"
+#include "piece_shape.h"
+#include "container.h"
+
+constexpr auto BLOCK_SIZE = 20;
+
+struct quad
+{
+	aabb get_bounding_box(const float *x, const float *y) const;
+
+	int p0, p1, p2, p3;
+};
+
+// Everything pieces of the same type have in common: rest shape, springs,
+// quads and texture coordinates, one per body. Built once per type and
+// shared by every instance, which only keeps its own particles and
+// bounding boxes.
+//
+// relax_springs_fixed, if set, relaxes this topology's springs with the
+// loop unrolled at compile time and returns the largest stretch; only the
+// built-in patterns have one.
+//
+// Blocks are numbered row*MAX_PIECE_COLS + col in the pattern of type.
+// Fragments left over when blocks are cleared keep the type and numbering
+// of the piece they came from, and so its texture.
+
+struct piece_topology
+{
+	using relax_fn = float (*)(float *x, float *y);
+
+	piece_topology(int type, const piece_shape& shape, const rgb& color, const vec2& uv_origin, const vec2& uv_block_size, relax_fn relax_springs_fixed = nullptr);
+
+	int type;
+	uint32_t blocks; // a bit for each block
+	rgb color;
+	std::vector<vec2> rest_positions;
+	std::vector<vec2> uvs; // parallel to rest_positions
+	std::vector<spring> springs;
+	std::vector<size_t> color_offsets; // where each color of springs starts, and the end
+	std::vector<quad> quads;
+	std::vector<int> quad_blocks; // parallel to quads
+	relax_fn relax_springs_fixed;
+};
+
+// What the last test of each pair of quads of two pieces found: the axis
+// that separated them, tried first the next time, or TOUCHING. Only a hint:
+// collisions come out the same with any contents.
+
+struct contact_cache
+{
+	static constexpr uint8_t TOUCHING = 0xff;
+
+	uint8_t axes[MAX_PIECE_QUADS][MAX_PIECE_QUADS] {};
+};
+
+class piece
+{
+public:
+	piece(const piece_topology& topology, particle_store& particles);
+
+	const piece_topology& get_topology() const
+	{ return *topology_; }
+
+	size_t get_num_particles() const
+	{ return topology_->rest_positions.size(); }
+
+	size_t get_num_quads() const
+	{ return topology_->quads.size(); }
+
+	void get_quad_corners(size_t quad, vec2 *corners) const
+	{ get_corners(topology_->quads[quad], corners); }
+
+	// interleaved x, y of every body, previous and current state
+
+	void write_states(float *prev_xy, float *xy) const;
+
+	void update_positions();
+	void relax_springs();
+	void constrain_to_walls(const container& walls);
+	void collide(piece& other, contact_cache& cache);
+
+	// the largest spring stretch or contact push this piece saw since its
+	// springs were last relaxed
+
+	float get_solver_error() const
+	{ return solver_error_; }
+
+	void move(const vec2& p);
+
+	// takes the position and velocity of each body from the body of whole
+	// with the same rest position; this must be a fragment of whole
+
+	void copy_bodies(const piece& whole);
+
+	// copies the bodies to the end of to and addresses them there from then
+	// on; to must take the place of the store they came from before the
+	// piece is used again
+
+	void move_particles(particle_store& to);
+
+	aabb get_bounding_box() const
+	{ return { min_pos_, max_pos_ }; }
+
+	void update_sleep_state();
+	void wake();
+
+	bool is_sleeping() const
+	{ return sleeping_; }
+
+	float get_motion() const
+	{ return sqrtf(motion_squared_); }
+
+	// the farthest any body moved in the last call to update_positions()
+
+	float get_step_length() const;
+
+	// takes every body back to where it was before the last step and then
+	// along the step again in num_substeps equal parts, calling fn() after
+	// each part; deltas is scratch space
+
+	template <typename F>
+	void substep(int num_substeps, std::vector<vec2>& deltas, F fn);
+
+private:
+	void get_corners(const quad& q, vec2 *corners) const;
+	void push_quad(const quad& q, const vec2& v);
+	void update_bounding_box();
+	vec2 get_centroid() const;
+
+	float *get_x() const
+	{ return &particles_->x[first_particle_]; }
+
+	float *get_y() const
+	{ return &particles_->y[first_particle_]; }
+
+	const piece_topology *topology_;
+	particle_store *particles_;
+	size_t first_particle_;
+	aabb quad_boxes_[MAX_PIECE_QUADS]; // parallel to topology_->quads
+	vec2 min_pos_, max_pos_;
+	float motion_squared_;
+	float solver_error_;
+	vec2 idle_centroid_;
+	int idle_updates_;
+	bool sleeping_;
+
+	piece(const piece&) = delete;
+	piece& operator=(const piece&) = delete;
+};
+
+template <typename F>
+void
+piece::substep(int num_substeps, std::vector<vec2>& deltas, F fn)
+{
+	float *x = get_x();
+	float *y = get_y();
+	const float *px = &particles_->px[first_particle_];
+	const float *py = &particles_->py[first_particle_];
+
+	const size_t num_particles = get_num_particles();
+
+	deltas.resize(num_particles);
+
+	for (size_t i = 0; i < num_particles; i++) {
+		deltas[i] = vec2(x[i] - px[i], y[i] - py[i])*(1.f/num_substeps);
+		x[i] = px[i];
+		y[i] = py[i];
+	}
+
+	for (int i = 0; i < num_substeps; i++) {
+		for (size_t j = 0; j < num_particles; j++) {
+			x[j] += deltas[j].x;
+			y[j] += deltas[j].y;
+		}
+
+		update_bounding_box();
+		fn();
+	}
+}
+
+class piece_factory
+{
+public:
+	static piece_factory& get_instance();
+
+	const piece_topology& get_topology(int type) const
+	{ return topologies_[type]; }
+
+	size_t get_num_types() const
+	{ return topologies_.size(); }
+
+	// the topology of the pattern of type with only the given blocks, which
+	// must be connected; built on first use and kept from then on
+
+	const piece_topology& get_fragment(int type, uint32_t blocks);
+
+	const piece_atlas& get_atlas() const
+	{ return atlas_; }
+
+private:
+	piece_factory();
+
+	piece_atlas atlas_;
+	std::vector<piece_topology> topologies_;
+
+	// keyed by type << MAX_PIECE_QUADS | blocks
+	std::map<uint32_t, piece_topology> fragments_;
+	std::mutex fragments_mutex_;
+
+	piece_factory(const piece_factory&) = delete;
+	piece_factory& operator=(const piece_factory&) = delete;
+};
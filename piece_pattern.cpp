@@ -1,7 +1,16 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(SCALAR_KERNELS) && defined(__SSE2__)
+#include <emmintrin.h>
+#define RASTER_SSE
+#endif
 
-#include "texture.h"
-#include "pixmap.h"
 #include "piece_pattern.h"
 
 namespace {
@@ -12,134 +21,435 @@ constexpr int INNER_BORDER = 6;
 constexpr int INNER_CORNER_RADIUS = 4;
 constexpr int INNER_INNER_BORDER = 2;
 
-struct rect
+// one texel wide at the deepest mip level, and cells start on a texel of
+// it, so its texels never average two cells
+constexpr int ATLAS_GUTTER = 1 << ATLAS_MAX_MIP_LEVEL;
+constexpr int CELL_WIDTH = MAX_PIECE_COLS*BLOCK_SIZE + 2*ATLAS_GUTTER;
+constexpr int CELL_HEIGHT = MAX_PIECE_ROWS*BLOCK_SIZE + 2*ATLAS_GUTTER;
+
+static_assert(CELL_WIDTH%ATLAS_GUTTER == 0 && CELL_HEIGHT%ATLAS_GUTTER == 0, "cells must line up with the deepest mip level");
+
+// bump when the rasterizer changes in a way the cache key doesn't capture
+constexpr int ATLAS_CACHE_VERSION = 1;
+
+size_t
+next_power_of_2(size_t n)
 {
-	int x, y, w, h;
-};
+	size_t p = 1;
+
+	while (p < n)
+		p *= 2;
+
+	return p;
+}
+
+//
+//  b l o c k   r a s t e r i z e r
+//
 
-struct veci2
+// A block is shaded by its neighbor mask alone: an outer rounded rectangle
+// with an inner one inset into it, joined to the border on the sides that
+// have a neighbor. Pixels are shaded a row at a time, four at a time where
+// SSE is available; coverage math is branch free and correctly rounded, so
+// both paths produce the same pixels.
+
+enum neighbor
 {
-	veci2 operator-(const veci2& v) const
-	{ return {x - v.x, y - v.y}; }
+	UP = 1,
+	DOWN = 2,
+	LEFT = 4,
+	RIGHT = 8,
+};
+
+constexpr int NUM_NEIGHBOR_MASKS = 16;
+
+constexpr auto INNER_SIZE = BLOCK_SIZE - 2*INNER_BORDER;
+
+// bridges to the neighbors cover [BRIDGE_BEGIN, BRIDGE_END] across the border
+
+constexpr auto BRIDGE_BEGIN = INNER_BORDER + INNER_CORNER_RADIUS + INNER_INNER_BORDER;
+constexpr auto BRIDGE_END = BLOCK_SIZE - INNER_BORDER - INNER_CORNER_RADIUS - INNER_INNER_BORDER - 1;
 
-	float length() const
-	{ return sqrtf(x*x + y*y); }
+constexpr float OUTER_SHADE = 1.f;
+constexpr float INNER_SHADE = .8f;
 
-	int x, y;
+// per row state: distances across the rows from the corner centers, and
+// what the border columns and the middle of the row look like
+
+struct block_row
+{
+	float outer_d;
+	float inner_d;
+	bool border; // row is in the top or bottom border
+	float bridge_t; // inner coverage of the bridge in a border row
+	float left_t, right_t; // inner coverage of the left and right border columns
 };
 
-float
-border_color(const veci2& p, const veci2& o, int radius)
+inline float
+clamp(float v, float lo, float hi)
 {
-	float l = (p - o).length();
+	return std::min(std::max(v, lo), hi);
+}
 
-	if (l < radius)
-		return 1;
-	else if (l > radius + 1)
-		return 0;
-	else
-		return 1. - (l - radius);
+// distance of p from [lo, hi]
+
+inline float
+distance_to_span(float p, float lo, float hi)
+{
+	return p - clamp(p, lo, hi);
+}
+
+// 1 inside, 0 more than a pixel out, linear in between
+
+inline float
+rounded_coverage(float dx, float dy, float radius)
+{
+	const float l = sqrtf(dx*dx + dy*dy);
+	return clamp(1.f - (l - radius), 0.f, 1.f);
 }
 
-float
-round_rect_color(const veci2& p, const rect& rc, int corner_radius)
+block_row
+make_block_row(int i, unsigned mask)
 {
-	const int x00 = rc.x;
-	const int x01 = rc.x + corner_radius;
+	block_row row;
 
-	const int x10 = rc.x + rc.w - corner_radius - 1;
-	const int x11 = rc.x + rc.w - 1;
+	row.outer_d = distance_to_span(i, CORNER_RADIUS, BLOCK_SIZE - CORNER_RADIUS - 1);
+	row.inner_d = distance_to_span(i, INNER_BORDER + INNER_CORNER_RADIUS, INNER_BORDER + INNER_SIZE - INNER_CORNER_RADIUS - 1);
 
-	const int y00 = rc.y;
-	const int y01 = rc.y + corner_radius;
+	const bool top = i < INNER_BORDER;
+	const bool bottom = i > BLOCK_SIZE - INNER_BORDER - 1;
 
-	const int y10 = rc.y + rc.h - corner_radius - 1;
-	const int y11 = rc.y + rc.h - 1;
+	row.border = top || bottom;
+	row.bridge_t = (top && (mask & UP)) || (bottom && (mask & DOWN));
 
-	const int x = p.x;
-	const int y = p.y;
+	const bool bridge = i >= BRIDGE_BEGIN && i <= BRIDGE_END;
 
-	if (x < x00 || x > x11 || y < y00 || y > y11)
-		return 0;
-	else if (x < x01 && y < y01)
-		return border_color(p, {x01, y01}, corner_radius);
-	else if (x < x01 && y > y10)
-		return border_color(p, {x01, y10}, corner_radius);
-	else if (x > x10 && y < y01)
-		return border_color(p, {x10, y01}, corner_radius);
-	else if (x > x10 && y > y10)
-		return border_color(p, {x10, y10}, corner_radius);
-	else
-		return 1;
+	row.left_t = !row.border && bridge && (mask & LEFT);
+	row.right_t = !row.border && bridge && (mask & RIGHT);
 
+	return row;
 }
 
-void
-draw_block(uint8_t *pixels, int stride, bool up, bool down, bool left, bool right)
+uint8_t
+shade(float t0, float t1)
 {
-	rect outer{0, 0, BLOCK_SIZE, BLOCK_SIZE};
-	rect inner{INNER_BORDER, INNER_BORDER, BLOCK_SIZE - 2*INNER_BORDER, BLOCK_SIZE - 2*INNER_BORDER};
+	return 255*t0*(OUTER_SHADE + t1*(INNER_SHADE - OUTER_SHADE));
+}
 
-	const float s0 = 1., s1 = .8;
+inline void
+shade_one(uint8_t *pixel, int j, const block_row& row)
+{
+	const float outer_d = distance_to_span(j, CORNER_RADIUS, BLOCK_SIZE - CORNER_RADIUS - 1);
+	const float t0 = rounded_coverage(row.outer_d, outer_d, CORNER_RADIUS);
+
+	float t1;
+
+	if (j < INNER_BORDER) {
+		t1 = row.left_t;
+	} else if (j > BLOCK_SIZE - INNER_BORDER - 1) {
+		t1 = row.right_t;
+	} else if (row.border) {
+		t1 = j >= BRIDGE_BEGIN && j <= BRIDGE_END ? row.bridge_t : 0;
+	} else {
+		const float inner_d = distance_to_span(j, INNER_BORDER + INNER_CORNER_RADIUS, INNER_BORDER + INNER_SIZE - INNER_CORNER_RADIUS - 1);
+		t1 = rounded_coverage(row.inner_d, inner_d, INNER_CORNER_RADIUS);
+	}
 
-	for (int i = 0; i < BLOCK_SIZE; i++) {
-		for (int j = 0; j < BLOCK_SIZE; j++) {
-			const veci2 p{i, j};
+	*pixel = shade(t0, t1);
+}
 
-			float t0 = round_rect_color(p, outer, CORNER_RADIUS);
+#if defined(RASTER_SSE)
+inline __m128
+select_4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
 
-			const int h0 = INNER_BORDER;
-			const int h1 = BLOCK_SIZE - INNER_BORDER - 1;
+inline __m128
+distance_to_span_4(__m128 p, float lo, float hi)
+{
+	return _mm_sub_ps(p, _mm_min_ps(_mm_max_ps(p, _mm_set1_ps(lo)), _mm_set1_ps(hi)));
+}
 
-			const int h2 = INNER_BORDER + INNER_CORNER_RADIUS + INNER_INNER_BORDER;
-			const int h3 = BLOCK_SIZE - INNER_BORDER - INNER_CORNER_RADIUS - INNER_INNER_BORDER - 1;
+inline __m128
+rounded_coverage_4(__m128 dx, __m128 dy, float radius)
+{
+	const __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+	const __m128 t = _mm_sub_ps(_mm_set1_ps(1.f), _mm_sub_ps(l, _mm_set1_ps(radius)));
+	return _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.f));
+}
 
-			float t1;
+inline void
+shade_4(uint8_t *pixels, int j, const block_row& row)
+{
+	const __m128 col = _mm_add_ps(_mm_set1_ps(j), _mm_setr_ps(0, 1, 2, 3));
 
-			if (i < h0)
-				t1 = left && j >= h2 && j <= h3;
-			else if (i > h1)
-				t1 = right && j >= h2 && j <= h3;
-			else if (j < h0)
-				t1 = up && i >= h2 && i <= h3;
-			else if (j > h1)
-				t1 = down && i >= h2 && i <= h3;
-			else
-				t1 = round_rect_color(p, inner, INNER_CORNER_RADIUS);
+	const __m128 outer_d = distance_to_span_4(col, CORNER_RADIUS, BLOCK_SIZE - CORNER_RADIUS - 1);
+	const __m128 t0 = rounded_coverage_4(_mm_set1_ps(row.outer_d), outer_d, CORNER_RADIUS);
 
-			*pixels++ = 255*t0*(s0 + t1*(s1 - s0));
-		}
+	__m128 middle;
 
-		pixels += stride - BLOCK_SIZE;
+	if (row.border) {
+		const __m128 bridge = _mm_and_ps(
+			_mm_cmpge_ps(col, _mm_set1_ps(BRIDGE_BEGIN)),
+			_mm_cmple_ps(col, _mm_set1_ps(BRIDGE_END)));
+		middle = select_4(bridge, _mm_set1_ps(row.bridge_t), _mm_setzero_ps());
+	} else {
+		const __m128 inner_d = distance_to_span_4(col, INNER_BORDER + INNER_CORNER_RADIUS, INNER_BORDER + INNER_SIZE - INNER_CORNER_RADIUS - 1);
+		middle = rounded_coverage_4(_mm_set1_ps(row.inner_d), inner_d, INNER_CORNER_RADIUS);
 	}
+
+	const __m128 left = _mm_cmplt_ps(col, _mm_set1_ps(INNER_BORDER));
+	const __m128 right = _mm_cmpgt_ps(col, _mm_set1_ps(BLOCK_SIZE - INNER_BORDER - 1));
+
+	const __m128 t1 = select_4(left, _mm_set1_ps(row.left_t), select_4(right, _mm_set1_ps(row.right_t), middle));
+
+	const __m128 v = _mm_mul_ps(
+		_mm_mul_ps(_mm_set1_ps(255), t0),
+		_mm_add_ps(_mm_set1_ps(OUTER_SHADE), _mm_mul_ps(t1, _mm_set1_ps(INNER_SHADE - OUTER_SHADE))));
+
+	// truncates like the scalar conversion; values are in [0, 255]
+
+	const __m128i w = _mm_cvttps_epi32(v);
+	const __m128i b = _mm_packus_epi16(_mm_packs_epi32(w, w), _mm_setzero_si128());
+
+	const int packed = _mm_cvtsi128_si32(b);
+	memcpy(pixels, &packed, 4);
 }
+#endif
+
+void
+draw_block(uint8_t *pixels, int stride, unsigned mask)
+{
+	for (int i = 0; i < BLOCK_SIZE; i++) {
+		const block_row row = make_block_row(i, mask);
+
+		int j = 0;
+
+#if defined(RASTER_SSE)
+		for (; j + 4 <= BLOCK_SIZE; j += 4)
+			shade_4(&pixels[j], j, row);
+#endif
+
+		for (; j < BLOCK_SIZE; j++)
+			shade_one(&pixels[j], j, row);
+
+		pixels += stride;
+	}
 }
 
-std::shared_ptr<gge::texture>
-make_piece_texture(const piece_pattern& p)
+// The 16 possible blocks, drawn the first time they're needed and then
+// copied into every atlas.
+
+class block_tiles
 {
-	const int width = MAX_PIECE_COLS*BLOCK_SIZE;
-	const int height = MAX_PIECE_ROWS*BLOCK_SIZE;
+public:
+	static const block_tiles& get_instance()
+	{
+		static const block_tiles tiles;
+		return tiles;
+	}
+
+	const uint8_t *get_tile(unsigned mask) const
+	{ return &pixels_[mask*BLOCK_SIZE*BLOCK_SIZE]; }
+
+private:
+	block_tiles()
+	: pixels_(NUM_NEIGHBOR_MASKS*BLOCK_SIZE*BLOCK_SIZE)
+	{
+		for (int i = 0; i < NUM_NEIGHBOR_MASKS; i++)
+			draw_block(&pixels_[i*BLOCK_SIZE*BLOCK_SIZE], BLOCK_SIZE, i);
+	}
+
+	std::vector<uint8_t> pixels_;
+};
 
-	gge::pixmap<gge::pixel_type::GRAY> pm(width, height);
+//
+//  c a c h e
+//
 
-	uint8_t *bits = &pm.data[0];
+// cached atlases are binary PGMs, so they can be looked at with anything
+
+bool
+load_pgm(const char *path, gge::pixmap<gge::pixel_type::GRAY>& pm)
+{
+	FILE *in = fopen(path, "rb");
+
+	if (!in)
+		return false;
+
+	size_t width, height;
+	int max_value;
+
+	const bool ok =
+		fscanf(in, "P5 %zu %zu %d", &width, &height, &max_value) == 3 &&
+		width == pm.width && height == pm.height && max_value == 255 &&
+		fgetc(in) != EOF &&
+		fread(&pm.data[0], 1, pm.data.size(), in) == pm.data.size();
+
+	fclose(in);
+
+	return ok;
+}
+
+void
+save_pgm(const char *path, const gge::pixmap<gge::pixel_type::GRAY>& pm)
+{
+	// written under another name and renamed, so a reader never sees half
+	// a file
+
+	const std::string temp_path = std::string(path) + ".tmp";
+
+	FILE *out = fopen(temp_path.c_str(), "wb");
+
+	if (!out)
+		return;
+
+	fprintf(out, "P5\n%zu %zu\n255\n", pm.width, pm.height);
+	fwrite(&pm.data[0], 1, pm.data.size(), out);
+
+	const bool ok = !ferror(out);
+
+	if (fclose(out) == 0 && ok)
+		rename(temp_path.c_str(), path);
+	else
+		remove(temp_path.c_str());
+}
+
+void
+draw_piece(uint8_t *bits, int stride, const piece_pattern& p)
+{
+	const block_tiles& tiles = block_tiles::get_instance();
+
+	auto is_set = [&] (int r, int c) {
+		return r >= 0 && r < MAX_PIECE_ROWS && c >= 0 && c < MAX_PIECE_COLS && p.pattern[r][c] == '#';
+	};
 
 	for (int r = 0; r < MAX_PIECE_ROWS; r++) {
 		for (int c = 0; c < MAX_PIECE_COLS; c++) {
-			if (p.pattern[r][c] != '#')
+			if (!is_set(r, c))
 				continue;
 
-			bool left = c > 0 && p.pattern[r][c - 1] == '#';
-			bool right = c < MAX_PIECE_COLS - 1 && p.pattern[r][c + 1] == '#';
-			bool up = r > 0 && p.pattern[r - 1][c] == '#';
-			bool down = r < MAX_PIECE_ROWS - 1 && p.pattern[r + 1][c] == '#';
+			unsigned mask = 0;
+
+			if (is_set(r - 1, c))
+				mask |= UP;
+
+			if (is_set(r + 1, c))
+				mask |= DOWN;
+
+			if (is_set(r, c - 1))
+				mask |= LEFT;
+
+			if (is_set(r, c + 1))
+				mask |= RIGHT;
+
+			const uint8_t *tile = tiles.get_tile(mask);
+			uint8_t *dest = &bits[BLOCK_SIZE*(r*stride + c)];
+
+			for (int i = 0; i < BLOCK_SIZE; i++)
+				memcpy(&dest[i*stride], &tile[i*BLOCK_SIZE], BLOCK_SIZE);
+		}
+	}
+}
+}
+
+//
+//  p i e c e _ a t l a s
+//
+
+// dimensions are rounded up to powers of two so the pixmap can be uploaded
+// as is
+
+piece_atlas::piece_atlas(const piece_pattern *patterns, size_t num_patterns)
+: patterns_(patterns)
+, num_patterns_(num_patterns)
+, cols_(ceilf(sqrtf(num_patterns)))
+, width_(next_power_of_2(cols_*CELL_WIDTH))
+, height_(next_power_of_2(((num_patterns + cols_ - 1)/cols_)*CELL_HEIGHT))
+{ }
+
+gge::pixmap<gge::pixel_type::GRAY>
+piece_atlas::make_pixmap(const char *cache_dir) const
+{
+	std::string cache_path;
+
+	if (cache_dir) {
+		char name[32];
+		snprintf(name, sizeof name, "/atlas-%016llx.pgm", static_cast<unsigned long long>(get_key()));
+
+		cache_path = std::string(cache_dir) + name;
+
+		gge::pixmap<gge::pixel_type::GRAY> pm(width_, height_);
+
+		if (load_pgm(cache_path.c_str(), pm))
+			return pm;
+	}
+
+	gge::pixmap<gge::pixel_type::GRAY> pm(width_, height_);
+
+	for (size_t i = 0; i < num_patterns_; i++) {
+		const size_t x = (i%cols_)*CELL_WIDTH + ATLAS_GUTTER;
+		const size_t y = (i/cols_)*CELL_HEIGHT + ATLAS_GUTTER;
+
+		draw_piece(&pm.data[y*pm.width + x], pm.width, patterns_[i]);
+	}
 
-			draw_block(&bits[BLOCK_SIZE*(r*width + c)], width, left, right, up, down);
+	// a cache that can't be written is only slower
+
+	if (!cache_path.empty())
+		save_pgm(cache_path.c_str(), pm);
+
+	return pm;
+}
+
+// everything the pixels depend on, so a stale file is never picked up
+
+uint64_t
+piece_atlas::get_key() const
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	auto add = [&] (int v) {
+		for (int i = 0; i < 4; i++) {
+			hash ^= (v >> 8*i) & 0xff;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	add(ATLAS_CACHE_VERSION);
+	add(BLOCK_SIZE);
+	add(CORNER_RADIUS);
+	add(INNER_BORDER);
+	add(INNER_CORNER_RADIUS);
+	add(INNER_INNER_BORDER);
+	add(ATLAS_GUTTER);
+	add(width_);
+	add(height_);
+
+	for (size_t i = 0; i < num_patterns_; i++) {
+		for (int r = 0; r < MAX_PIECE_ROWS; r++) {
+			for (int c = 0; c < MAX_PIECE_COLS; c++)
+				add(patterns_[i].pattern[r][c] == '#');
 		}
 	}
 
-	auto tex = std::make_shared<gge::texture>();
-	tex->load(pm);
-	return tex;
+	return hash;
+}
+
+vec2
+piece_atlas::get_origin(size_t i) const
+{
+	const float x = (i%cols_)*CELL_WIDTH + ATLAS_GUTTER;
+	const float y = (i/cols_)*CELL_HEIGHT + ATLAS_GUTTER;
+
+	return vec2(x/width_, y/height_);
+}
+
+vec2
+piece_atlas::get_block_size() const
+{
+	return vec2(
+		static_cast<float>(BLOCK_SIZE)/width_,
+		static_cast<float>(BLOCK_SIZE)/height_);
 }
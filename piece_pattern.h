@@ -1,10 +1,10 @@
 #pragma once
 
-#include <memory>
+#include <cstddef>
+#include <cstdint>
 
-namespace gge {
-class texture;
-}
+#include "vec2.h"
+#include "pixmap.h"
 
 constexpr auto MAX_PIECE_ROWS = 4;
 constexpr auto MAX_PIECE_COLS = 4;
@@ -20,4 +20,93 @@ struct piece_pattern
 	rgb color;
 };
 
-std::shared_ptr<gge::texture> make_piece_texture(const piece_pattern& p);
+// in the header so piece topologies can be worked out at compile time
+
+constexpr piece_pattern PIECE_PATTERNS[]
+	{
+	{ { "    ",
+	    " ## ",
+	    " ## ",
+	    "    "  },
+	    {0, 0, 1} },
+
+	{ { " #  ",
+	    " #  ",
+	    " #  ",
+	    " #  "  },
+	    {0, 1, 0} },
+
+	{ { " #  ",
+	    " #  ",
+	    " ## ",
+	    "    "  },
+	    {0, 1, 1} },
+
+	{ { "  # ",
+	    "  # ",
+	    " ## ",
+	    "    "  },
+	    {1, 0, 0} },
+
+	{ { " #  ",
+	    " ## ",
+	    " #  ",
+	    "    "  },
+	    {1, 0, 1} },
+
+	{ { " #  ",
+	    " ## ",
+	    "  # ",
+	    "    "  },
+	    {1, 1, 0} },
+
+	{ { "  # ",
+	    " ## ",
+	    " #  ",
+	    "    "  },
+	    {1, 1, 1} } };
+
+constexpr size_t NUM_PIECE_PATTERNS = sizeof PIECE_PATTERNS/sizeof *PIECE_PATTERNS;
+
+// deepest mip level the atlas can be sampled from without cells bleeding
+// into each other
+
+constexpr size_t ATLAS_MAX_MIP_LEVEL = 3;
+
+// All piece textures packed into a single texture, one cell per pattern.
+// Cells are separated by a transparent gutter so filtering at a piece's
+// edge doesn't pick up its neighbors, down to ATLAS_MAX_MIP_LEVEL. The
+// atlas only knows the layout, uploading the pixmap is up to the renderer.
+
+class piece_atlas
+{
+public:
+	piece_atlas(const piece_pattern *patterns, size_t num_patterns);
+
+	// texture coordinates of the top left corner of pattern i
+
+	vec2 get_origin(size_t i) const;
+
+	// texture coordinate extent of a single block
+
+	vec2 get_block_size() const;
+
+	size_t get_width() const
+	{ return width_; }
+
+	size_t get_height() const
+	{ return height_; }
+
+	// with cache_dir set, a previously generated atlas is read from there
+	// if one matches, and a newly generated one is written there
+
+	gge::pixmap<gge::pixel_type::GRAY> make_pixmap(const char *cache_dir = nullptr) const;
+
+private:
+	uint64_t get_key() const;
+
+	const piece_pattern *patterns_;
+	size_t num_patterns_;
+	size_t cols_;
+	size_t width_, height_;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "kernels.h"
+#include "piece_pattern.h"
+
+constexpr auto MAX_PIECE_QUADS = MAX_PIECE_ROWS*MAX_PIECE_COLS;
+constexpr auto MAX_PIECE_BODIES = (MAX_PIECE_ROWS + 1)*(MAX_PIECE_COLS + 1);
+constexpr auto MAX_PIECE_SPRINGS = 6*MAX_PIECE_QUADS;
+
+// a body touches at most 8 springs, so greedy coloring never needs more
+// than 15 colors
+
+constexpr auto MAX_SPRING_COLORS = 16;
+
+// Bodies, springs and quads of a pattern in fixed size arrays. Everything
+// here is constexpr, so the shapes of the built-in patterns are worked out
+// by the compiler, but the same code builds shapes of patterns only known
+// at runtime.
+//
+// Bodies are numbered in order of first appearance scanning blocks row by
+// row, springs are sorted by color (see kernels::relax_springs).
+
+struct piece_shape
+{
+	struct body
+	{
+		int row, col;
+	};
+
+	struct block
+	{
+		int p0, p1, p2, p3; // clockwise from the top left
+		int row, col;
+	};
+
+	size_t num_bodies;
+	body bodies[MAX_PIECE_BODIES];
+
+	size_t num_springs;
+	spring springs[MAX_PIECE_SPRINGS];
+
+	size_t num_colors;
+	size_t color_offsets[MAX_SPRING_COLORS + 1];
+
+	size_t num_blocks;
+	block blocks[MAX_PIECE_QUADS];
+};
+
+namespace detail {
+
+// Newton's method; good to the last bit of a float for the lengths found
+// in a piece
+
+constexpr double
+const_sqrt(double x)
+{
+	if (x <= 0)
+		return 0;
+
+	double r = x > 1 ? x : 1;
+
+	for (int i = 0; i < 64; i++) {
+		const double next = .5*(r + x/r);
+
+		if (next == r)
+			break;
+
+		r = next;
+	}
+
+	return r;
+}
+
+constexpr int
+add_body(piece_shape& s, int row, int col)
+{
+	for (size_t i = 0; i < s.num_bodies; i++) {
+		if (s.bodies[i].row == row && s.bodies[i].col == col)
+			return i;
+	}
+
+	s.bodies[s.num_bodies] = { row, col };
+	return s.num_bodies++;
+}
+
+constexpr void
+add_spring(piece_shape& s, int v0, int v1, float block_size)
+{
+	for (size_t i = 0; i < s.num_springs; i++) {
+		const spring& t = s.springs[i];
+
+		if ((t.p0 == v0 && t.p1 == v1) || (t.p0 == v1 && t.p1 == v0))
+			return;
+	}
+
+	const float dx = (s.bodies[v0].col - s.bodies[v1].col)*block_size;
+	const float dy = (s.bodies[v0].row - s.bodies[v1].row)*block_size;
+
+	s.springs[s.num_springs++] = { v0, v1, static_cast<float>(const_sqrt(dx*dx + dy*dy)) };
+}
+
+// greedy edge coloring followed by a stable sort on color, so no two
+// springs of the same color share a body
+
+constexpr void
+color_springs(piece_shape& s)
+{
+	uint32_t body_colors[MAX_PIECE_BODIES] {};
+	int spring_colors[MAX_PIECE_SPRINGS] {};
+
+	s.num_colors = 0;
+
+	for (size_t i = 0; i < s.num_springs; i++) {
+		uint32_t& c0 = body_colors[s.springs[i].p0];
+		uint32_t& c1 = body_colors[s.springs[i].p1];
+
+		const uint32_t used = c0 | c1;
+
+		int color = 0;
+		while (used & (1u << color))
+			++color;
+
+		c0 |= 1u << color;
+		c1 |= 1u << color;
+
+		spring_colors[i] = color;
+
+		if (color + 1 > static_cast<int>(s.num_colors))
+			s.num_colors = color + 1;
+	}
+
+	spring sorted[MAX_PIECE_SPRINGS] {};
+	size_t count = 0;
+
+	for (size_t c = 0; c < s.num_colors; c++) {
+		s.color_offsets[c] = count;
+
+		for (size_t i = 0; i < s.num_springs; i++) {
+			if (spring_colors[i] == static_cast<int>(c))
+				sorted[count++] = s.springs[i];
+		}
+	}
+
+	s.color_offsets[s.num_colors] = count;
+
+	for (size_t i = 0; i < s.num_springs; i++)
+		s.springs[i] = sorted[i];
+}
+
+}
+
+constexpr piece_shape
+make_piece_shape(const piece_pattern& pattern, float block_size)
+{
+	piece_shape s {};
+
+	for (int i = 0; i < MAX_PIECE_ROWS; i++) {
+		for (int j = 0; j < MAX_PIECE_COLS; j++) {
+			if (pattern.pattern[i][j] != '#')
+				continue;
+
+			const int v0 = detail::add_body(s, i, j);
+			const int v1 = detail::add_body(s, i, j + 1);
+			const int v2 = detail::add_body(s, i + 1, j + 1);
+			const int v3 = detail::add_body(s, i + 1, j);
+
+			detail::add_spring(s, v0, v1, block_size);
+			detail::add_spring(s, v1, v2, block_size);
+			detail::add_spring(s, v2, v3, block_size);
+			detail::add_spring(s, v3, v0, block_size);
+
+			detail::add_spring(s, v0, v2, block_size);
+			detail::add_spring(s, v1, v3, block_size);
+
+			s.blocks[s.num_blocks++] = { v0, v1, v2, v3, i, j };
+		}
+	}
+
+	detail::color_springs(s);
+
+	return s;
+}
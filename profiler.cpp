@@ -0,0 +1,186 @@
+#include <algorithm>
+
+#include "profiler.h"
+
+namespace {
+const char *SECTION_NAMES[] { "update", "integrate", "broad phase", "solve", "springs", "walls", "collide", "draw", "capture", "swap" };
+const char *COUNTER_NAMES[] { "iterations", "pairs", "sat tests", "early outs", "contacts", "substeps", "cleared" };
+
+static_assert(sizeof SECTION_NAMES/sizeof *SECTION_NAMES == profiler::NUM_SECTIONS, "missing section name");
+static_assert(sizeof COUNTER_NAMES/sizeof *COUNTER_NAMES == profiler::NUM_COUNTERS, "missing counter name");
+
+// trace events are written out once they pile up past this
+constexpr size_t MAX_PENDING_TRACE_EVENTS = 4096;
+
+// index into thread_names_ of the calling thread
+thread_local int trace_thread = 0;
+}
+
+constexpr int profiler::NUM_SECTIONS;
+constexpr int profiler::NUM_COUNTERS;
+constexpr int profiler::HISTORY_SIZE;
+
+const char *
+get_section_name(profile_section section)
+{
+	return SECTION_NAMES[static_cast<int>(section)];
+}
+
+const char *
+get_counter_name(profile_counter counter)
+{
+	return COUNTER_NAMES[static_cast<int>(counter)];
+}
+
+profiler&
+profiler::get_instance()
+{
+	static profiler instance;
+	return instance;
+}
+
+profiler::profiler()
+: epoch_(clock::now())
+, history_()
+, history_head_(0)
+, num_frames_(0)
+, trace_(nullptr)
+, thread_names_ { "main" }
+{
+	std::fill(std::begin(section_ms_), std::end(section_ms_), 0);
+
+	for (auto& i : counters_)
+		i = 0;
+}
+
+profiler::~profiler()
+{
+	stop_trace();
+}
+
+void
+profiler::add_time(profile_section section, clock::time_point start, clock::time_point end)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	section_ms_[static_cast<int>(section)] += std::chrono::duration<float, std::milli>(end - start).count();
+
+	if (trace_) {
+		trace_events_.push_back({ trace_thread, section, start, end - start });
+
+		if (trace_events_.size() >= MAX_PENDING_TRACE_EVENTS)
+			flush_trace();
+	}
+}
+
+void
+profiler::add_duration(profile_section section, double ms)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	section_ms_[static_cast<int>(section)] += ms;
+}
+
+void
+profiler::end_frame()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	frame& f = history_[history_head_];
+
+	std::copy(std::begin(section_ms_), std::end(section_ms_), f.section_ms);
+	std::fill(std::begin(section_ms_), std::end(section_ms_), 0);
+
+	for (int i = 0; i < NUM_COUNTERS; i++)
+		f.counters[i] = counters_[i].exchange(0, std::memory_order_relaxed);
+
+	history_head_ = (history_head_ + 1)%HISTORY_SIZE;
+	num_frames_ = std::min(num_frames_ + 1, HISTORY_SIZE);
+
+	if (trace_) {
+		flush_trace();
+
+		const long long ts = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - epoch_).count();
+
+		fprintf(trace_, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"args\":{", ts);
+
+		for (int i = 0; i < NUM_COUNTERS; i++)
+			fprintf(trace_, "%s\"%s\":%zu", i ? "," : "", COUNTER_NAMES[i], f.counters[i]);
+
+		fprintf(trace_, "}}");
+	}
+}
+
+void
+profiler::set_thread_name(const char *name)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	trace_thread = thread_names_.size();
+	thread_names_.push_back(name);
+
+	if (trace_)
+		write_thread_name(trace_thread);
+}
+
+bool
+profiler::start_trace(const char *path)
+{
+	stop_trace();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (!(trace_ = fopen(path, "w")))
+		return false;
+
+	fprintf(trace_, "{\"traceEvents\":[\n");
+
+	// every other event is written with a leading comma, so open with a
+	// metadata event
+
+	fprintf(trace_, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"hell\"}}");
+
+	for (size_t i = 0; i < thread_names_.size(); i++)
+		write_thread_name(i);
+
+	return true;
+}
+
+void
+profiler::stop_trace()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (!trace_)
+		return;
+
+	flush_trace();
+
+	fprintf(trace_, "\n]}\n");
+	fclose(trace_);
+
+	trace_ = nullptr;
+}
+
+void
+profiler::write_thread_name(int thread)
+{
+	fprintf(trace_, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", thread + 1, thread_names_[thread].c_str());
+}
+
+void
+profiler::flush_trace()
+{
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	for (auto& i : trace_events_) {
+		// fractional microseconds keep short sections from collapsing to 0
+		const double ts = duration_cast<nanoseconds>(i.start - epoch_).count()*1e-3;
+		const double dur = duration_cast<nanoseconds>(i.duration).count()*1e-3;
+
+		fprintf(trace_, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", SECTION_NAMES[static_cast<int>(i.section)], i.thread + 1, ts, dur);
+	}
+
+	trace_events_.clear();
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdio>
+
+// Per-frame timings and counters for the hot paths. Sections and counters
+// can be added from any thread; a frame is whatever was added between two
+// calls to end_frame(). Optionally streams every timed section to a Chrome
+// trace (chrome://tracing) file, one track per named thread.
+
+enum class profile_section
+{
+	UPDATE,
+	INTEGRATE,
+	BROAD_PHASE,
+	SOLVE,
+	SPRINGS, // the parts of solve, summed over solver threads
+	WALLS,
+	COLLIDE,
+	DRAW,
+	CAPTURE,
+	SWAP,
+	NUM_SECTIONS
+};
+
+enum class profile_counter
+{
+	ITERATIONS, // solver passes, summed over islands
+	PAIRS_TESTED,
+	SAT_TESTS,
+	EARLY_OUTS, // SAT tests settled by the cached axis
+	CONTACTS,
+	SUBSTEPS, // collision substeps of fast pieces
+	BLOCKS_CLEARED, // blocks taken out by full rows
+	NUM_COUNTERS
+};
+
+const char *
+get_section_name(profile_section section);
+
+const char *
+get_counter_name(profile_counter counter);
+
+class profiler
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	static constexpr int NUM_SECTIONS = static_cast<int>(profile_section::NUM_SECTIONS);
+	static constexpr int NUM_COUNTERS = static_cast<int>(profile_counter::NUM_COUNTERS);
+
+	// frames kept for the overlay graph
+	static constexpr int HISTORY_SIZE = 120;
+
+	struct frame
+	{
+		float section_ms[NUM_SECTIONS];
+		size_t counters[NUM_COUNTERS];
+	};
+
+	static profiler& get_instance();
+
+	~profiler();
+
+	void add_time(profile_section section, clock::time_point start, clock::time_point end);
+
+	// time spent in pieces too small and many to trace one by one; it
+	// counts towards the frame, but not the trace
+
+	void add_duration(profile_section section, double ms);
+
+	void add_count(profile_counter counter, size_t count)
+	{ counters_[static_cast<int>(counter)].fetch_add(count, std::memory_order_relaxed); }
+
+	// closes the current frame and pushes it to the history
+
+	void end_frame();
+
+	// i = 0 is the last completed frame
+
+	const frame& get_frame(int i) const
+	{ return history_[(history_head_ + HISTORY_SIZE - 1 - i)%HISTORY_SIZE]; }
+
+	int get_num_frames() const
+	{ return num_frames_; }
+
+	// gives the calling thread its own track in the trace; sections timed
+	// from threads without a name go to the "main" track
+
+	void set_thread_name(const char *name);
+
+	bool start_trace(const char *path);
+	void stop_trace();
+
+private:
+	profiler();
+
+	struct trace_event
+	{
+		int thread;
+		profile_section section;
+		clock::time_point start;
+		clock::duration duration;
+	};
+
+	void write_thread_name(int thread);
+	void flush_trace();
+
+	// guards everything but the counters and the history, which only the
+	// thread calling end_frame() touches
+	std::mutex mutex_;
+
+	clock::time_point epoch_;
+	float section_ms_[NUM_SECTIONS];
+	std::atomic<size_t> counters_[NUM_COUNTERS];
+	frame history_[HISTORY_SIZE];
+	int history_head_;
+	int num_frames_;
+
+	FILE *trace_;
+	std::vector<trace_event> trace_events_;
+	std::vector<std::string> thread_names_; // indexed by trace thread id
+
+	profiler(const profiler&) = delete;
+	profiler& operator=(const profiler&) = delete;
+};
+
+// times the enclosing block
+
+class profile_scope
+{
+public:
+	profile_scope(profile_section section)
+	: section_(section)
+	, start_(profiler::clock::now())
+	{ }
+
+	~profile_scope()
+	{ profiler::get_instance().add_time(section_, start_, profiler::clock::now()); }
+
+private:
+	profile_section section_;
+	profiler::clock::time_point start_;
+};
@@ -0,0 +1,224 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+
+#include <cstdio>
+
+#include "shaders.h"
+#include "profiler_overlay.h"
+
+namespace {
+constexpr int GLYPH_WIDTH = 3;
+constexpr int GLYPH_HEIGHT = 5;
+constexpr int CHAR_ADVANCE = GLYPH_WIDTH + 1;
+constexpr int LINE_HEIGHT = GLYPH_HEIGHT + 2;
+
+constexpr int MARGIN = 4;
+constexpr int GRAPH_HEIGHT = 64;
+
+struct glyph
+{
+	char c;
+	const char *bits; // GLYPH_HEIGHT rows of GLYPH_WIDTH, top row first
+};
+
+const glyph FONT[]
+	{
+	{ '0', "####.##.##.####" }, { '1', ".#.##..#..#.###" },
+	{ '2', "###..#####..###" }, { '3', "###..####..####" },
+	{ '4', "#.##.####..#..#" }, { '5', "####..###..####" },
+	{ '6', "####..####.####" }, { '7', "###..#..#..#..#" },
+	{ '8', "####.#####.####" }, { '9', "####.####..####" },
+	{ 'a', "####.#####.##.#" }, { 'b', "##.#.###.#.###." },
+	{ 'c', "####..#..#..###" }, { 'd', "##.#.##.##.###." },
+	{ 'e', "####..####..###" }, { 'f', "####..####..#.." },
+	{ 'g', "####..#.##.####" }, { 'h', "#.##.#####.##.#" },
+	{ 'i', "###.#..#..#.###" }, { 'j', "..#..#..##.####" },
+	{ 'k', "#.##.###.#.##.#" }, { 'l', "#..#..#..#..###" },
+	{ 'm', "#.########.##.#" }, { 'n', "##.#.##.##.##.#" },
+	{ 'o', "####.##.##.####" }, { 'p', "####.#####..#.." },
+	{ 'q', "####.##.####..#" }, { 'r', "##.#.###.#.##.#" },
+	{ 's', "####..###..####" }, { 't', "###.#..#..#..#." },
+	{ 'u', "#.##.##.##.####" }, { 'v', "#.##.##.##.#.#." },
+	{ 'w', "#.##.########.#" }, { 'x', "#.##.#.#.#.##.#" },
+	{ 'y', "#.##.#.#..#..#." }, { 'z', "###..#.#.#..###" },
+	{ '.', ".............#." }, { ':', "....#.....#...." },
+	{ '/', "..#..#.#.#..#.." }, { '-', "......###......" },
+	};
+
+const glyph *
+find_glyph(char c)
+{
+	for (auto& i : FONT) {
+		if (i.c == c)
+			return &i;
+	}
+
+	return nullptr;
+}
+
+void
+add_rect(gge::vertex_array_flat& va, float x0, float y0, float x1, float y1)
+{
+	va.push_back({ x0, y0 });
+	va.push_back({ x1, y0 });
+	va.push_back({ x1, y1 });
+	va.push_back({ x0, y1 });
+}
+
+const float SECTION_COLORS[profiler::NUM_SECTIONS][3]
+	{
+	{ .5, .5, .5 },	// update
+	{ 1, 1, 0 },	// integrate
+	{ 1, .5, 0 },	// broad phase
+	{ .5, 0, 0 },	// solve
+	{ 0, 1, 0 },	// springs
+	{ 0, 1, 1 },	// walls
+	{ 1, 0, 0 },	// collide
+	{ 0, .5, 1 },	// draw
+	{ .5, 1, .5 },	// capture
+	{ 1, 0, 1 },	// swap
+	};
+}
+
+profiler_overlay::profiler_overlay(int width, int height, float frame_budget_ms)
+: width_(width)
+, height_(height)
+, frame_budget_ms_(frame_budget_ms)
+{
+	shaders::build(program_, "profiler overlay", shaders::FLAT_VERTEX, shaders::FLAT_FRAGMENT);
+}
+
+// glyphs that aren't in the font are drawn as blanks
+
+void
+profiler_overlay::add_text(gge::vertex_array_flat& va, float x, float y, const char *text)
+{
+	for (const char *p = text; *p; p++, x += CHAR_ADVANCE) {
+		const glyph *g = find_glyph(*p);
+
+		if (!g)
+			continue;
+
+		for (int i = 0; i < GLYPH_HEIGHT; i++) {
+			for (int j = 0; j < GLYPH_WIDTH; j++) {
+				if (g->bits[i*GLYPH_WIDTH + j] == '#')
+					add_rect(va, x + j, y - i - 1, x + j + 1, y - i);
+			}
+		}
+	}
+}
+
+void
+profiler_overlay::draw(const gge::mat4& transform)
+{
+	const profiler& prof = profiler::get_instance();
+	const int num_frames = prof.get_num_frames();
+
+	if (num_frames == 0)
+		return;
+
+	text_va_.clear();
+
+	for (auto& i : section_va_)
+		i.clear();
+
+	// per section average and max over the history
+
+	float y = height_ - MARGIN;
+	char buf[32];
+
+	for (int i = 0; i < profiler::NUM_SECTIONS; i++) {
+		float total = 0, max = 0;
+
+		for (int j = 0; j < num_frames; j++) {
+			const float ms = prof.get_frame(j).section_ms[i];
+			total += ms;
+			max = std::max(max, ms);
+		}
+
+		add_text(section_va_[i], MARGIN, y, get_section_name(static_cast<profile_section>(i)));
+
+		snprintf(buf, sizeof buf, "%6.2f %6.2f", total/num_frames, max);
+		add_text(text_va_, MARGIN + 12*CHAR_ADVANCE, y, buf);
+
+		y -= LINE_HEIGHT;
+	}
+
+	const profiler::frame& last = prof.get_frame(0);
+
+	for (int i = 0; i < profiler::NUM_COUNTERS; i++) {
+		snprintf(buf, sizeof buf, "%-11s %6zu", get_counter_name(static_cast<profile_counter>(i)), last.counters[i]);
+		add_text(text_va_, MARGIN, y, buf);
+
+		y -= LINE_HEIGHT;
+	}
+
+	// stacked bars, newest frame on the right; update is drawn as whatever
+	// its phases didn't account for, and solve is split between its parts
+	// by the share of thread time each took
+
+	const float graph_bottom = y - MARGIN - GRAPH_HEIGHT;
+	const float ms_scale = .5f*GRAPH_HEIGHT/frame_budget_ms_;
+	const float right = std::min<float>(width_ - MARGIN, MARGIN + profiler::HISTORY_SIZE);
+
+	for (int i = 0; i < num_frames; i++) {
+		const profiler::frame& f = prof.get_frame(i);
+		const float x = right - i - 1;
+
+		const int first_part = static_cast<int>(profile_section::SPRINGS);
+		const int last_part = static_cast<int>(profile_section::COLLIDE);
+
+		float phases = 0;
+		for (int j = static_cast<int>(profile_section::INTEGRATE); j <= static_cast<int>(profile_section::SOLVE); j++)
+			phases += f.section_ms[j];
+
+		float parts = 0;
+		for (int j = first_part; j <= last_part; j++)
+			parts += f.section_ms[j];
+
+		const float solve = f.section_ms[static_cast<int>(profile_section::SOLVE)];
+
+		float bar_y = graph_bottom;
+
+		for (int j = 0; j < profiler::NUM_SECTIONS; j++) {
+			float ms = f.section_ms[j];
+
+			if (j == static_cast<int>(profile_section::UPDATE))
+				ms = std::max(0.f, ms - phases);
+			else if (j == static_cast<int>(profile_section::SOLVE) && parts > 0)
+				ms = 0;
+			else if (j >= first_part && j <= last_part)
+				ms = parts > 0 ? solve*ms/parts : 0;
+
+			const float top = std::min(bar_y + ms*ms_scale, graph_bottom + GRAPH_HEIGHT);
+
+			if (top > bar_y)
+				add_rect(section_va_[j], x, bar_y, x + 1, top);
+
+			bar_y = top;
+		}
+	}
+
+	// frame budget
+
+	const float budget_y = graph_bottom + frame_budget_ms_*ms_scale;
+	add_rect(text_va_, right - profiler::HISTORY_SIZE, budget_y, right, budget_y + 1);
+
+	program_.use();
+	program_.set_uniform("transform", transform);
+
+	program_.set_uniform("color", 1, 1, 1, 1);
+	text_va_.draw_quads();
+
+	for (int i = 0; i < profiler::NUM_SECTIONS; i++) {
+		if (section_va_[i].empty())
+			continue;
+
+		const float *c = SECTION_COLORS[i];
+		program_.set_uniform("color", c[0], c[1], c[2], 1);
+		section_va_[i].draw_quads();
+	}
+
+	gge::program::unuse();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "vertex_array.h"
+#include "program.h"
+#include "mat4.h"
+#include "profiler.h"
+
+// Draws the profiler history over the game: a stacked bar per frame with a
+// line at the frame budget, and average/max milliseconds per section plus
+// the last frame's counters as text, in window coordinates with y up taken
+// to clip space by the transform passed to draw().
+
+class profiler_overlay
+{
+public:
+	profiler_overlay(int width, int height, float frame_budget_ms);
+
+	void draw(const gge::mat4& transform);
+
+private:
+	void add_text(gge::vertex_array_flat& va, float x, float y, const char *text);
+
+	int width_, height_;
+	float frame_budget_ms_;
+	gge::program program_;
+
+	// quads of each color
+	gge::vertex_array_flat text_va_;
+	gge::vertex_array_flat section_va_[profiler::NUM_SECTIONS];
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+#include "vertex_array.h"
+#include "mat4.h"
+
+namespace gge {
+
+namespace detail {
+
+const struct
+{
+	GLuint location;
+	const char *name;
+} ATTRIBUTE_NAMES[]
+	{
+	{ attribute::POSITION, "position" },
+	{ attribute::TEXUV, "texuv" },
+	{ attribute::COLOR, "color" },
+	};
+
+inline std::string
+get_info_log(GLuint id, bool is_program)
+{
+	GLint length = 0;
+
+	if (is_program)
+		glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
+	else
+		glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+
+	if (length <= 0)
+		return std::string();
+
+	std::vector<GLchar> log(length);
+
+	if (is_program)
+		glGetProgramInfoLog(id, length, nullptr, &log[0]);
+	else
+		glGetShaderInfoLog(id, length, nullptr, &log[0]);
+
+	return std::string(&log[0]);
+}
+
+} // detail
+
+// A linked vertex and fragment shader. Attributes are bound by name to the
+// gge::attribute locations: position, texuv and color.
+
+class program
+{
+public:
+	program()
+	: id_(glCreateProgram())
+	{ }
+
+	~program()
+	{ glDeleteProgram(id_); }
+
+	// false, with what the compiler or linker had to say in log, if it
+	// doesn't build
+
+	bool build(const char *vertex_source, const char *fragment_source, std::string& log)
+	{
+		const GLuint vs = compile(GL_VERTEX_SHADER, vertex_source, log);
+
+		if (!vs)
+			return false;
+
+		const GLuint fs = compile(GL_FRAGMENT_SHADER, fragment_source, log);
+
+		if (!fs) {
+			glDeleteShader(vs);
+			return false;
+		}
+
+		glAttachShader(id_, vs);
+		glAttachShader(id_, fs);
+
+		for (auto& i : detail::ATTRIBUTE_NAMES)
+			glBindAttribLocation(id_, i.location, i.name);
+
+		glLinkProgram(id_);
+
+		// flagged for deletion, they go with the program
+
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+
+		GLint linked;
+		glGetProgramiv(id_, GL_LINK_STATUS, &linked);
+
+		if (!linked) {
+			log = detail::get_info_log(id_, true);
+			return false;
+		}
+
+		return true;
+	}
+
+	void use() const
+	{ glUseProgram(id_); }
+
+	static void unuse()
+	{ glUseProgram(0); }
+
+	// uniforms of the program in use
+
+	void set_uniform(const char *name, GLint v) const
+	{ glUniform1i(glGetUniformLocation(id_, name), v); }
+
+	void set_uniform(const char *name, float r, float g, float b, float a) const
+	{ glUniform4f(glGetUniformLocation(id_, name), r, g, b, a); }
+
+	void set_uniform(const char *name, const mat4& m) const
+	{ glUniformMatrix4fv(glGetUniformLocation(id_, name), 1, GL_FALSE, m.m); }
+
+private:
+	static GLuint compile(GLenum type, const char *source, std::string& log)
+	{
+		const GLuint id = glCreateShader(type);
+
+		glShaderSource(id, 1, &source, nullptr);
+		glCompileShader(id);
+
+		GLint compiled;
+		glGetShaderiv(id, GL_COMPILE_STATUS, &compiled);
+
+		if (!compiled) {
+			log = detail::get_info_log(id, false);
+			glDeleteShader(id);
+			return 0;
+		}
+
+		return id;
+	}
+
+	GLuint id_;
+
+	program(const program&) = delete;
+	program& operator=(const program&) = delete;
+};
+
+} // gge
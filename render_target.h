@@ -0,0 +1,84 @@
+#pragma once
+
+#include <GL/glew.h>
+
+namespace gge {
+
+// An offscreen framebuffer with an RGBA color texture to draw into, then
+// sample from. Needs ARB_framebuffer_object or GL 3.0, see is_supported().
+
+class render_target
+{
+public:
+	render_target(int width, int height)
+	: width_(width)
+	, height_(height)
+	{
+		glGenTextures(1, &texture_id_);
+		bind_texture();
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width_, height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+		glGenFramebuffers(1, &framebuffer_id_);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id_);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_id_, 0);
+
+		complete_ = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+		unbind();
+	}
+
+	~render_target()
+	{
+		glDeleteFramebuffers(1, &framebuffer_id_);
+		glDeleteTextures(1, &texture_id_);
+	}
+
+	static bool is_supported()
+	{ return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object; }
+
+	// false if the driver can't draw into this one
+
+	bool is_complete() const
+	{ return complete_; }
+
+	// draws go here, with the viewport covering the whole target, until
+	// unbind()
+
+	void bind() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id_);
+		glViewport(0, 0, width_, height_);
+	}
+
+	// back to the window; the viewport is left for the caller to set
+
+	static void unbind()
+	{ glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+	void bind_texture() const
+	{ glBindTexture(GL_TEXTURE_2D, texture_id_); }
+
+	int get_width() const
+	{ return width_; }
+
+	int get_height() const
+	{ return height_; }
+
+private:
+	render_target(const render_target&) = delete;
+	render_target& operator=(const render_target&) = delete;
+
+	int width_, height_;
+	GLuint texture_id_;
+	GLuint framebuffer_id_;
+	bool complete_;
+};
+
+}
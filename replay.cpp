@@ -0,0 +1,290 @@
+#include <cstdio>
+#include <cstring>
+
+#include "replay.h"
+
+namespace {
+const char MAGIC[4] { 'H', 'R', 'P', 'L' };
+constexpr uint8_t VERSION = 5;
+
+// version 1 logs have no solver settings and ran 30 passes every update,
+// logs before version 3 never cleared rows, logs before version 4 always
+// had the plain bowl, and logs before version 5 gave every island the
+// whole max_iterations
+constexpr uint8_t MIN_VERSION = 1;
+
+class writer
+{
+public:
+	writer(FILE *out)
+	: out_(out)
+	{ }
+
+	void put_byte(uint8_t b)
+	{ fputc(b, out_); }
+
+	void put_varint(uint32_t v)
+	{
+		while (v >= 0x80) {
+			put_byte((v & 0x7f) | 0x80);
+			v >>= 7;
+		}
+
+		put_byte(v);
+	}
+
+	void put_signed(int32_t v)
+	{ put_varint((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31)); }
+
+	void put_float(float f)
+	{
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof bits);
+
+		for (int i = 0; i < 4; i++)
+			put_byte(bits >> 8*i);
+	}
+
+private:
+	FILE *out_;
+};
+
+class reader
+{
+public:
+	reader(FILE *in)
+	: in_(in)
+	, ok_(true)
+	{ }
+
+	bool ok() const
+	{ return ok_; }
+
+	bool at_end()
+	{
+		const int c = fgetc(in_);
+
+		if (c == EOF)
+			return true;
+
+		ungetc(c, in_);
+		return false;
+	}
+
+	uint8_t get_byte()
+	{
+		const int c = fgetc(in_);
+
+		if (c == EOF) {
+			ok_ = false;
+			return 0;
+		}
+
+		return c;
+	}
+
+	uint32_t get_varint()
+	{
+		uint32_t v = 0;
+
+		for (int shift = 0; shift < 35; shift += 7) {
+			const uint8_t b = get_byte();
+			v |= static_cast<uint32_t>(b & 0x7f) << shift;
+
+			if (!(b & 0x80))
+				return v;
+		}
+
+		ok_ = false;
+		return 0;
+	}
+
+	int32_t get_signed()
+	{
+		const uint32_t v = get_varint();
+		return static_cast<int32_t>((v >> 1) ^ -(v & 1));
+	}
+
+	float get_float()
+	{
+		uint32_t bits = 0;
+
+		for (int i = 0; i < 4; i++)
+			bits |= static_cast<uint32_t>(get_byte()) << 8*i;
+
+		float f;
+		memcpy(&f, &bits, sizeof f);
+
+		return f;
+	}
+
+private:
+	FILE *in_;
+	bool ok_;
+};
+}
+
+replay_log::replay_log(uint32_t seed, int width, int height, bool allow_sleeping, const solver_options& solver, bool clear_rows, walls_kind walls)
+: seed_(seed)
+, width_(width)
+, height_(height)
+, allow_sleeping_(allow_sleeping)
+, solver_(solver)
+, clear_rows_(clear_rows)
+, walls_(walls)
+, num_updates_(0)
+{ }
+
+void
+replay_log::add_spawn(uint32_t update, int piece_type, int x)
+{
+	replay_event e;
+
+	e.update = update;
+	e.kind = replay_event::type::SPAWN;
+	e.piece_type = piece_type;
+	e.x = x;
+
+	events_.push_back(e);
+}
+
+bool
+replay_log::save(const char *path) const
+{
+	FILE *out = fopen(path, "wb");
+
+	if (!out)
+		return false;
+
+	fwrite(MAGIC, sizeof MAGIC, 1, out);
+
+	writer w(out);
+
+	w.put_byte(VERSION);
+	w.put_varint(seed_);
+	w.put_varint(width_);
+	w.put_varint(height_);
+	w.put_byte(allow_sleeping_);
+	w.put_varint(solver_.min_iterations);
+	w.put_varint(solver_.max_iterations);
+	w.put_float(solver_.tolerance);
+	w.put_varint(solver_.base_iterations);
+	w.put_float(solver_.contact_iterations);
+	w.put_byte(clear_rows_);
+	w.put_byte(static_cast<uint8_t>(walls_));
+	w.put_varint(num_updates_);
+
+	uint32_t prev_update = 0;
+
+	for (auto& i : events_) {
+		w.put_varint(i.update - prev_update);
+		w.put_byte(static_cast<uint8_t>(i.kind));
+
+		switch (i.kind) {
+			case replay_event::type::SPAWN:
+				w.put_byte(i.piece_type);
+				w.put_signed(i.x);
+				break;
+		}
+
+		prev_update = i.update;
+	}
+
+	const bool ok = !ferror(out);
+
+	return fclose(out) == 0 && ok;
+}
+
+bool
+replay_log::load(const char *path)
+{
+	FILE *in = fopen(path, "rb");
+
+	if (!in)
+		return false;
+
+	char magic[sizeof MAGIC];
+
+	if (fread(magic, sizeof magic, 1, in) != 1 || memcmp(magic, MAGIC, sizeof MAGIC)) {
+		fclose(in);
+		return false;
+	}
+
+	reader r(in);
+
+	const uint8_t version = r.get_byte();
+
+	if (version < MIN_VERSION || version > VERSION) {
+		fclose(in);
+		return false;
+	}
+
+	seed_ = r.get_varint();
+	width_ = r.get_varint();
+	height_ = r.get_varint();
+	allow_sleeping_ = r.get_byte();
+
+	solver_ = solver_options();
+	solver_.min_iterations = 1;
+	solver_.max_iterations = 30;
+	solver_.tolerance = 0;
+
+	if (version >= 2) {
+		solver_.min_iterations = r.get_varint();
+		solver_.max_iterations = r.get_varint();
+		solver_.tolerance = r.get_float();
+	}
+
+	solver_.base_iterations = solver_.max_iterations;
+	solver_.contact_iterations = 0;
+
+	if (version >= 5) {
+		solver_.base_iterations = r.get_varint();
+		solver_.contact_iterations = r.get_float();
+	}
+
+	clear_rows_ = version >= 3 && r.get_byte();
+
+	walls_ = walls_kind::BOWL;
+
+	if (version >= 4) {
+		walls_ = static_cast<walls_kind>(r.get_byte());
+
+		if (walls_ != walls_kind::BOWL && walls_ != walls_kind::BOWL_FIELD) {
+			fclose(in);
+			return false;
+		}
+	}
+
+	num_updates_ = r.get_varint();
+
+	events_.clear();
+
+	uint32_t update = 0;
+
+	while (r.ok() && !r.at_end()) {
+		replay_event e;
+
+		update += r.get_varint();
+
+		e.update = update;
+		e.kind = static_cast<replay_event::type>(r.get_byte());
+
+		switch (e.kind) {
+			case replay_event::type::SPAWN:
+				e.piece_type = r.get_byte();
+				e.x = r.get_signed();
+				break;
+
+			default:
+				fclose(in);
+				return false;
+		}
+
+		events_.push_back(e);
+	}
+
+	fclose(in);
+
+	return r.ok();
+}
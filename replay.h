@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include "world.h"
+
+// Everything needed to reproduce a session: the world seed, solver
+// settings and kind of walls, and everything that happened to the world
+// from outside the simulation, tagged with the update it happened before.
+// Playing the events back into a world with the same seed, size, solver
+// settings and walls gives the same simulation, windowed or headless.
+//
+// On disk it's a short header followed by the events, with update numbers
+// delta encoded as varints.
+
+struct replay_event
+{
+	enum class type : uint8_t { SPAWN };
+
+	uint32_t update;
+	type kind;
+
+	// SPAWN
+	uint8_t piece_type;
+	int16_t x;
+};
+
+class replay_log
+{
+public:
+	// the bowl the world makes by default, or a distance field of its
+	// outline, which collides a little differently
+
+	enum class walls_kind : uint8_t { BOWL, BOWL_FIELD };
+
+	replay_log(uint32_t seed = 0, int width = 0, int height = 0, bool allow_sleeping = true, const solver_options& solver = solver_options(), bool clear_rows = false, walls_kind walls = walls_kind::BOWL);
+
+	bool load(const char *path);
+	bool save(const char *path) const;
+
+	void add_spawn(uint32_t update, int piece_type, int x);
+
+	uint32_t get_seed() const
+	{ return seed_; }
+
+	int get_width() const
+	{ return width_; }
+
+	int get_height() const
+	{ return height_; }
+
+	bool get_allow_sleeping() const
+	{ return allow_sleeping_; }
+
+	const solver_options& get_solver() const
+	{ return solver_; }
+
+	bool get_clear_rows() const
+	{ return clear_rows_; }
+
+	walls_kind get_walls() const
+	{ return walls_; }
+
+	// updates run while recording
+
+	uint32_t get_num_updates() const
+	{ return num_updates_; }
+
+	void set_num_updates(uint32_t num_updates)
+	{ num_updates_ = num_updates; }
+
+	const std::vector<replay_event>& get_events() const
+	{ return events_; }
+
+private:
+	uint32_t seed_;
+	int width_, height_;
+	bool allow_sleeping_;
+	solver_options solver_;
+	bool clear_rows_;
+	walls_kind walls_;
+	uint32_t num_updates_;
+	std::vector<replay_event> events_;
+};
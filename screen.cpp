@@ -0,0 +1,93 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+
+#include "render_target.h"
+#include "shaders.h"
+#include "screen.h"
+
+screen::screen(int window_width, int window_height, int width, int height, int resolution_width, int resolution_height)
+: window_width_(window_width)
+, window_height_(window_height)
+, width_(width)
+, projection_(gge::mat4::ortho(0, width, 0, height))
+{
+	const float scale = std::min(static_cast<float>(window_width)/width, static_cast<float>(window_height)/height);
+
+	viewport_width_ = width*scale + .5f;
+	viewport_height_ = height*scale + .5f;
+	viewport_x_ = (window_width - viewport_width_)/2;
+	viewport_y_ = (window_height - viewport_height_)/2;
+
+	if (resolution_width == 0 || resolution_height == 0) {
+		resolution_width = viewport_width_;
+		resolution_height = viewport_height_;
+	}
+
+	// nothing to scale at the rectangle's own size
+
+	if ((resolution_width != viewport_width_ || resolution_height != viewport_height_) && gge::render_target::is_supported()) {
+		target_.reset(new gge::render_target(resolution_width, resolution_height));
+
+		if (!target_->is_complete())
+			target_.reset();
+	}
+
+	if (target_) {
+		shaders::build(program_, "textured", shaders::TEXTURED_VERTEX, shaders::TEXTURED_FRAGMENT);
+
+		quad_va_ = { { 0, 0, 0, 0 }, { 1, 0, 1, 0 }, { 1, 1, 1, 1 }, { 0, 1, 0, 1 } };
+	}
+}
+
+screen::~screen() = default;
+
+float
+screen::get_scale() const
+{
+	return static_cast<float>(target_ ? target_->get_width() : viewport_width_)/width_;
+}
+
+void
+screen::begin_frame()
+{
+	// clears ignore the viewport, so straight into the window this clears
+	// the bars too
+
+	if (target_) {
+		target_->bind();
+		glClear(GL_COLOR_BUFFER_BIT);
+	} else {
+		glClear(GL_COLOR_BUFFER_BIT);
+		glViewport(viewport_x_, viewport_y_, viewport_width_, viewport_height_);
+	}
+}
+
+void
+screen::end_frame()
+{
+	if (target_) {
+		gge::render_target::unbind();
+
+		glClear(GL_COLOR_BUFFER_BIT);
+		glViewport(viewport_x_, viewport_y_, viewport_width_, viewport_height_);
+
+		target_->bind_texture();
+
+		program_.use();
+		program_.set_uniform("transform", gge::mat4::ortho(0, 1, 0, 1));
+		program_.set_uniform("image", 0);
+
+		quad_va_.draw_quads();
+
+		gge::program::unuse();
+	}
+
+	set_window_viewport();
+}
+
+void
+screen::set_window_viewport() const
+{
+	glViewport(0, 0, window_width_, window_height_);
+}
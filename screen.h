@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+
+#include "vertex_array.h"
+#include "program.h"
+#include "mat4.h"
+
+namespace gge {
+class render_target;
+}
+
+// Where frames are drawn. A frame covers (0, 0) to (width, height) in its
+// own coordinates, y up, and is shown in the largest rectangle of the same
+// aspect ratio that fits in the window, centered, with black bars around.
+//
+// Drawn straight into that rectangle by default. Given a resolution, and
+// if the GL has framebuffer objects, it is drawn into an offscreen target
+// of that many pixels instead and then scaled to the rectangle with linear
+// filtering in a single pass, so fill costs depend on the resolution and
+// not on the window.
+
+class screen
+{
+public:
+	// a resolution of 0 by 0 is the size of the rectangle in the window
+
+	screen(int window_width, int window_height, int width, int height, int resolution_width = 0, int resolution_height = 0);
+	~screen();
+
+	// frame coordinates to clip space
+
+	const gge::mat4& get_projection() const
+	{ return projection_; }
+
+	// pixels per unit, horizontally, frames are drawn at
+
+	float get_scale() const;
+
+	// starts a frame, cleared
+
+	void begin_frame();
+
+	// puts the frame in the window, which is left the target of draws with
+	// the viewport covering all of it
+
+	void end_frame();
+
+private:
+	void set_window_viewport() const;
+
+	int window_width_, window_height_;
+	int width_;
+
+	// the rectangle the frame goes in, window pixels
+	int viewport_x_, viewport_y_;
+	int viewport_width_, viewport_height_;
+
+	gge::mat4 projection_;
+
+	std::unique_ptr<gge::render_target> target_; // null if drawn straight
+	gge::program program_;
+	gge::vertex_array_texuv quad_va_;
+
+	screen(const screen&) = delete;
+	screen& operator=(const screen&) = delete;
+};
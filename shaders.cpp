@@ -0,0 +1,115 @@
+#include <string>
+
+#include "panic.h"
+#include "shaders.h"
+
+namespace shaders {
+
+#define PRECISION \
+	"#ifdef GL_ES\n" \
+	"precision mediump float;\n" \
+	"#endif\n"
+
+const char *FLAT_VERTEX =
+	"uniform mat4 transform;\n"
+	"attribute vec2 position;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_Position = transform*vec4(position, 0., 1.);\n"
+	"}\n";
+
+const char *FLAT_FRAGMENT =
+	PRECISION
+	"uniform vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = color;\n"
+	"}\n";
+
+const char *PIECE_VERTEX =
+	"uniform mat4 transform;\n"
+	"attribute vec2 position;\n"
+	"attribute vec2 texuv;\n"
+	"attribute vec3 color;\n"
+	"varying vec2 frag_texuv;\n"
+	"varying vec3 frag_color;\n"
+	"void main()\n"
+	"{\n"
+	"	frag_texuv = texuv;\n"
+	"	frag_color = color;\n"
+	"	gl_Position = transform*vec4(position, 0., 1.);\n"
+	"}\n";
+
+const char *PIECE_FRAGMENT =
+	PRECISION
+	"uniform sampler2D atlas;\n"
+	"varying vec2 frag_texuv;\n"
+	"varying vec3 frag_color;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = texture2D(atlas, frag_texuv)*vec4(frag_color, 1.);\n"
+	"}\n";
+
+// GLSL 1.40 for buffer textures, gl_VertexID and gl_InstanceID. Elements
+// index the bodies of every mesh in one buffer, so gl_VertexID less the
+// mesh's first vertex is the body within the piece.
+
+const char *INSTANCED_PIECE_VERTEX =
+	"#version 140\n"
+	"uniform mat4 transform;\n"
+	"uniform samplerBuffer positions;\n"
+	"uniform isamplerBuffer instances;\n"
+	"uniform int first_body;\n"
+	"uniform int first_instance;\n"
+	"uniform int first_vertex;\n"
+	"in vec2 texuv;\n"
+	"out vec2 frag_texuv;\n"
+	"void main()\n"
+	"{\n"
+	"	int body = first_body + texelFetch(instances, first_instance + gl_InstanceID).r + gl_VertexID - first_vertex;\n"
+	"	frag_texuv = texuv;\n"
+	"	gl_Position = transform*vec4(texelFetch(positions, body).rg, 0., 1.);\n"
+	"}\n";
+
+const char *INSTANCED_PIECE_FRAGMENT =
+	"#version 140\n"
+	"uniform sampler2D atlas;\n"
+	"uniform vec4 color;\n"
+	"in vec2 frag_texuv;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = texture(atlas, frag_texuv)*color;\n"
+	"}\n";
+
+const char *TEXTURED_VERTEX =
+	"uniform mat4 transform;\n"
+	"attribute vec2 position;\n"
+	"attribute vec2 texuv;\n"
+	"varying vec2 frag_texuv;\n"
+	"void main()\n"
+	"{\n"
+	"	frag_texuv = texuv;\n"
+	"	gl_Position = transform*vec4(position, 0., 1.);\n"
+	"}\n";
+
+const char *TEXTURED_FRAGMENT =
+	PRECISION
+	"uniform sampler2D image;\n"
+	"varying vec2 frag_texuv;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = texture2D(image, frag_texuv);\n"
+	"}\n";
+
+#undef PRECISION
+
+void
+build(gge::program& p, const char *name, const char *vertex_source, const char *fragment_source)
+{
+	std::string log;
+
+	if (!p.build(vertex_source, fragment_source, log))
+		panic("failed to build the %s program:\n%s", name, log.c_str());
+}
+
+}
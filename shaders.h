@@ -0,0 +1,37 @@
+#pragma once
+
+#include "program.h"
+
+// GLSL sources for everything drawn, in the subset GLSL 1.10 and GLSL ES
+// 1.00 share but for the instanced pieces. Every vertex shader takes its
+// transform to clip space from a mat4 uniform named transform.
+
+namespace shaders {
+
+// position only, every fragment the color uniform
+extern const char *FLAT_VERTEX;
+extern const char *FLAT_FRAGMENT;
+
+// position, texuv and color; the texture from the atlas sampler is
+// modulated by the color
+extern const char *PIECE_VERTEX;
+extern const char *PIECE_FRAGMENT;
+
+// GLSL 1.40: one instance per piece of a mesh, texuv per body; body
+// positions are fetched from the positions buffer texture, starting at
+// first_body, at the offset the instances buffer texture has for the
+// instance, from first_instance on. The atlas is modulated by the color
+// uniform.
+extern const char *INSTANCED_PIECE_VERTEX;
+extern const char *INSTANCED_PIECE_FRAGMENT;
+
+// position and texuv, straight from the image sampler
+extern const char *TEXTURED_VERTEX;
+extern const char *TEXTURED_FRAGMENT;
+
+// builds p or panics with the compiler output, name saying which it was
+
+void
+build(gge::program& p, const char *name, const char *vertex_source, const char *fragment_source);
+
+}
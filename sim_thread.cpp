@@ -0,0 +1,106 @@
+#include <algorithm>
+
+#include "profiler.h"
+#include "sim_thread.h"
+
+namespace {
+// past this many updates in a row the simulation slows down instead of
+// trying to catch up
+constexpr int MAX_CATCH_UP_UPDATES = 5;
+}
+
+sim_thread::sim_thread(world& w, int updates_per_second)
+: world_(w)
+, update_interval_(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1./updates_per_second)))
+, back_(&slots_[0])
+, ready_(&slots_[1])
+, front_(&slots_[2])
+, fresh_(false)
+, quit_(false)
+{
+	// the first frames draw the world as it starts out
+
+	const auto now = clock::now();
+
+	for (auto& i : slots_) {
+		world_.publish(i.snapshot);
+		i.time = now;
+	}
+
+	thread_ = std::thread(&sim_thread::run, this);
+}
+
+sim_thread::~sim_thread()
+{
+	stop();
+}
+
+void
+sim_thread::stop()
+{
+	if (!thread_.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+
+	quit_cv_.notify_one();
+	thread_.join();
+}
+
+const world_snapshot&
+sim_thread::acquire(float& alpha)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (fresh_) {
+			std::swap(front_, ready_);
+			fresh_ = false;
+		}
+	}
+
+	const auto since = std::chrono::duration<float>(clock::now() - front_->time);
+	alpha = std::min(since/update_interval_, 1.f);
+
+	return front_->snapshot;
+}
+
+void
+sim_thread::run()
+{
+	profiler::get_instance().set_thread_name("simulation");
+
+	auto next_update = clock::now() + update_interval_;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+
+			if (quit_cv_.wait_until(lock, next_update, [this] { return quit_; }))
+				break;
+		}
+
+		int updates = 0;
+
+		for (; clock::now() >= next_update && updates < MAX_CATCH_UP_UPDATES; ++updates) {
+			world_.update();
+			next_update += update_interval_;
+		}
+
+		back_->time = next_update - update_interval_;
+
+		if (updates == MAX_CATCH_UP_UPDATES)
+			next_update = std::max(next_update, clock::now());
+
+		world_.publish(back_->snapshot);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::swap(back_, ready_);
+			fresh_ = true;
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "world.h"
+
+// Steps a world at a fixed rate on a thread of its own and publishes a
+// snapshot after every batch of updates, so the world and whatever draws it
+// run side by side. Three snapshots take turns: one being written, the
+// latest published and the one being drawn, so neither side ever waits for
+// the other to be done with a snapshot.
+//
+// Nothing else may touch the world until the thread is stopped.
+
+class sim_thread
+{
+public:
+	sim_thread(world& w, int updates_per_second);
+	~sim_thread();
+
+	// the latest published snapshot, untouched by the simulation until the
+	// next call; alpha is how far along the next update we are, for
+	// world_renderer::draw
+
+	const world_snapshot& acquire(float& alpha);
+
+	// waits for the update in progress and joins the thread
+
+	void stop();
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct slot
+	{
+		world_snapshot snapshot;
+		clock::time_point time; // when the update published was due
+	};
+
+	void run();
+
+	world& world_;
+	clock::duration update_interval_;
+
+	slot slots_[3];
+	slot *back_, *ready_, *front_; // written, latest published, drawn
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable quit_cv_;
+	bool fresh_; // ready_ was published since the last acquire()
+	bool quit_;
+
+	sim_thread(const sim_thread&) = delete;
+	sim_thread& operator=(const sim_thread&) = delete;
+};
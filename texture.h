@@ -2,7 +2,11 @@
 
 #include <GL/glew.h>
 
+#include <vector>
+#include <algorithm>
+
 #include "pixmap.h"
+#include "compressed_pixmap.h"
 
 namespace gge {
 
@@ -35,6 +39,35 @@ struct pixel_type_to_format<pixel_type::RGB_ALPHA>
 	static const GLint format = GL_RGBA;
 };
 
+// sized formats for immutable storage
+
+template <pixel_type PixelType>
+struct pixel_type_to_sized_format;
+
+template <>
+struct pixel_type_to_sized_format<pixel_type::GRAY>
+{
+	static const GLenum format = GL_LUMINANCE8;
+};
+
+template <>
+struct pixel_type_to_sized_format<pixel_type::GRAY_ALPHA>
+{
+	static const GLenum format = GL_LUMINANCE8_ALPHA8;
+};
+
+template <>
+struct pixel_type_to_sized_format<pixel_type::RGB>
+{
+	static const GLenum format = GL_RGB8;
+};
+
+template <>
+struct pixel_type_to_sized_format<pixel_type::RGB_ALPHA>
+{
+	static const GLenum format = GL_RGBA8;
+};
+
 template <typename T>
 static T
 next_power_of_2(T n)
@@ -47,6 +80,42 @@ next_power_of_2(T n)
 	return p;
 }
 
+static inline GLenum
+get_gl_format(compressed_format format)
+{
+	switch (format) {
+		case compressed_format::DXT1:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+		case compressed_format::ETC2_RGB8:
+			return GL_COMPRESSED_RGB8_ETC2;
+
+		case compressed_format::ASTC_4x4:
+			return GL_COMPRESSED_RGBA_ASTC_4x4_KHR;
+
+		case compressed_format::ASTC_6x6:
+			return GL_COMPRESSED_RGBA_ASTC_6x6_KHR;
+
+		case compressed_format::ASTC_8x8:
+			return GL_COMPRESSED_RGBA_ASTC_8x8_KHR;
+	}
+
+	return 0;
+}
+
+// levels in a full mipmap chain down to 1x1
+
+static inline GLsizei
+num_mip_levels(size_t width, size_t height)
+{
+	GLsizei levels = 1;
+
+	for (size_t size = std::max(width, height); size > 1; size /= 2)
+		++levels;
+
+	return levels;
+}
+
 } // detail
 
 class texture
@@ -55,6 +124,8 @@ public:
 	texture()
 	: orig_width_(0), width_(0)
 	, orig_height_(0), height_(0)
+	, mipmaps_(false)
+	, immutable_(false)
 	{ glGenTextures(1, &id_); }
 
 	~texture()
@@ -78,33 +149,149 @@ public:
 	void set_parameter(GLenum name, GLint value) const
 	{ bind(); glTexParameteri(GL_TEXTURE_2D, name, value); }
 
-	static void set_env_mode(GLint mode)
-	{ glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode); }
+	// Uploads straight from pm, never through a resized copy. Without NPOT
+	// support pm goes into the top left corner of a power of two texture
+	// and the rest is cleared, so texture coordinates need scaling by
+	// get_orig_width()/get_width() and get_orig_height()/get_height().
+	//
+	// Storage is immutable where ARB_texture_storage is available. With
+	// max_level set, mip levels down to it (or to 1x1, if that comes
+	// first) are allocated and regenerated on every upload.
 
 	template <pixel_type PixelType>
-	void load(const pixmap<PixelType>& pm)
+	void load(const pixmap<PixelType>& pm, size_t max_level = 0)
 	{
 		orig_width_ = pm.width;
-		width_ = detail::next_power_of_2(orig_width_);
-
 		orig_height_ = pm.height;
-		height_ = detail::next_power_of_2(orig_height_);
 
-		bind();
+		if (GLEW_VERSION_2_0 || GLEW_ARB_texture_non_power_of_two) {
+			width_ = orig_width_;
+			height_ = orig_height_;
+		} else {
+			width_ = detail::next_power_of_2(orig_width_);
+			height_ = detail::next_power_of_2(orig_height_);
+		}
 
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		const GLsizei levels = std::min<GLsizei>(max_level + 1, detail::num_mip_levels(width_, height_));
+
+		mipmaps_ = levels > 1;
+
+		// immutable storage can't be redefined, start over with a new name
+
+		if (immutable_) {
+			glDeleteTextures(1, &id_);
+			glGenTextures(1, &id_);
+			immutable_ = false;
+		}
+
+		bind();
 
 		static const GLint format = detail::pixel_type_to_format<PixelType>::format;
 
-		glTexImage2D(
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+		if (mipmaps_ && !has_generate_mipmap())
+			glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+
+		if (GLEW_ARB_texture_storage) {
+			glTexStorage2D(GL_TEXTURE_2D, levels, detail::pixel_type_to_sized_format<PixelType>::format, width_, height_);
+			immutable_ = true;
+		} else if (width_ != orig_width_ || height_ != orig_height_) {
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width_, height_, 0, format, GL_UNSIGNED_BYTE, nullptr);
+		} else {
+			// the common case: a single call, no separate allocation
+
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width_, height_, 0, format, GL_UNSIGNED_BYTE, &pm.data[0]);
+
+			if (mipmaps_)
+				generate_mipmaps();
+
+			return;
+		}
+
+		clear_padding<PixelType>();
+		update(pm, 0, 0, orig_width_, orig_height_);
+	}
+
+	// Compressed pixmaps are uploaded as a single level at their own size;
+	// without NPOT support they must be a power of two already.
+
+	void load(const compressed_pixmap& pm)
+	{
+		orig_width_ = width_ = pm.width;
+		orig_height_ = height_ = pm.height;
+		mipmaps_ = false;
+
+		if (immutable_) {
+			glDeleteTextures(1, &id_);
+			glGenTextures(1, &id_);
+			immutable_ = false;
+		}
+
+		bind();
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+		glCompressedTexImage2D(
 			GL_TEXTURE_2D,
 			0,
-			format,
+			detail::get_gl_format(pm.format),
 			width_, height_,
 			0,
-			format,
-			GL_UNSIGNED_BYTE,
-			&pm.resize(width_, height_).data[0]);
+			pm.data.size(),
+			&pm.data[0]);
+	}
+
+	static bool is_supported(compressed_format format)
+	{
+		switch (format) {
+			case compressed_format::DXT1:
+				return GLEW_EXT_texture_compression_s3tc;
+
+			case compressed_format::ETC2_RGB8:
+				return GLEW_ARB_ES3_compatibility;
+
+			default:
+				return GLEW_KHR_texture_compression_astc_ldr;
+		}
+	}
+
+	// The format to compress generated textures to on this GL, false if
+	// there's none. Desktop drivers that take ETC2 tend to decompress it on
+	// upload, so DXT1 goes first.
+
+	static bool pick_compressed_format(compressed_format& format)
+	{
+		for (auto i : { compressed_format::DXT1, compressed_format::ETC2_RGB8 }) {
+			if (is_supported(i)) {
+				format = i;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// uploads the given region of pm to the same place in the texture,
+	// straight from pm's rows
+
+	template <pixel_type PixelType>
+	void update(const pixmap<PixelType>& pm, size_t x, size_t y, size_t width, size_t height)
+	{
+		static const GLint format = detail::pixel_type_to_format<PixelType>::format;
+
+		bind();
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, pm.width);
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, GL_UNSIGNED_BYTE, &pm.data[y*pm.width*pm.pixel_size + x*pm.pixel_size]);
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+		if (mipmaps_)
+			generate_mipmaps();
 	}
 
 	size_t get_width() const
@@ -120,11 +307,48 @@ public:
 	{ return orig_height_; }
 
 private:
+	static bool has_generate_mipmap()
+	{ return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object; }
+
+	// a no-op where GL_GENERATE_MIPMAP took care of it
+
+	void generate_mipmaps() const
+	{
+		if (has_generate_mipmap())
+			glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	// zeroes the area right of and below the pixmap in a padded texture
+
+	template <pixel_type PixelType>
+	void clear_padding() const
+	{
+		static const GLint format = detail::pixel_type_to_format<PixelType>::format;
+
+		const size_t right = width_ - orig_width_;
+		const size_t bottom = height_ - orig_height_;
+
+		if (!right && !bottom)
+			return;
+
+		const std::vector<uint8_t> zeros(std::max(right*orig_height_, width_*bottom)*pixmap<PixelType>::pixel_size);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		if (right)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, orig_width_, 0, right, orig_height_, format, GL_UNSIGNED_BYTE, &zeros[0]);
+
+		if (bottom)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, orig_height_, width_, bottom, format, GL_UNSIGNED_BYTE, &zeros[0]);
+	}
+
 	texture(const texture&) = delete;
 	texture& operator=(const texture&) = delete;
 
 	size_t orig_width_, width_;
 	size_t orig_height_, height_;
+	bool mipmaps_;
+	bool immutable_;
 	GLuint id_;
 };
 
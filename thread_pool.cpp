@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+namespace {
+// workers count from 1, anything else is the calling thread
+thread_local size_t thread_index = 0;
+}
+
+thread_pool::thread_pool(int num_threads)
+: job_(nullptr)
+, count_(0), grain_(1)
+, next_(0)
+, busy_(0)
+, generation_(0)
+, quit_(false)
+{
+	if (num_threads <= 0)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (int i = 1; i < num_threads; i++)
+		workers_.push_back(std::thread(&thread_pool::worker_loop, this, i));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+
+	work_cv_.notify_all();
+
+	for (auto& i : workers_)
+		i.join();
+}
+
+size_t
+thread_pool::get_thread_index()
+{
+	return thread_index;
+}
+
+void
+thread_pool::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+	grain = std::max<size_t>(grain, 1);
+
+	// not worth waking anybody up
+
+	if (workers_.empty() || count <= grain) {
+		for (size_t i = 0; i < count; i += grain)
+			fn(i, std::min(i + grain, count));
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		job_ = &fn;
+		count_ = count;
+		grain_ = grain;
+		next_ = 0;
+		busy_ = workers_.size();
+		++generation_;
+	}
+
+	work_cv_.notify_all();
+
+	run_chunks();
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_cv_.wait(lock, [this] { return busy_ == 0; });
+
+	job_ = nullptr;
+}
+
+void
+thread_pool::run_chunks()
+{
+	for (;;) {
+		const size_t begin = next_.fetch_add(grain_);
+
+		if (begin >= count_)
+			break;
+
+		(*job_)(begin, std::min(begin + grain_, count_));
+	}
+}
+
+void
+thread_pool::worker_loop(size_t index)
+{
+	thread_index = index;
+
+	unsigned generation = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			work_cv_.wait(lock, [&] { return quit_ || generation_ != generation; });
+
+			if (quit_)
+				return;
+
+			generation = generation_;
+		}
+
+		run_chunks();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			if (--busy_ == 0)
+				done_cv_.notify_one();
+		}
+	}
+}
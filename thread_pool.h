@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+class thread_pool
+{
+public:
+	// num_threads counts the calling thread, so 1 runs everything inline;
+	// 0 picks one thread per hardware core
+
+	thread_pool(int num_threads);
+	~thread_pool();
+
+	// calls fn(begin, end) over chunks of at most grain indices covering
+	// [0, count) and returns when every chunk is done
+
+	void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+	size_t get_num_threads() const
+	{ return workers_.size() + 1; }
+
+	// which of get_num_threads() runs the calling chunk of a parallel_for,
+	// 0 for the thread that called it
+
+	static size_t get_thread_index();
+
+private:
+	void worker_loop(size_t index);
+	void run_chunks();
+
+	std::vector<std::thread> workers_;
+
+	std::mutex mutex_;
+	std::condition_variable work_cv_;
+	std::condition_variable done_cv_;
+
+	const std::function<void(size_t, size_t)> *job_;
+	size_t count_, grain_;
+	std::atomic<size_t> next_;
+	size_t busy_;
+	unsigned generation_;
+	bool quit_;
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+};
@@ -3,6 +3,8 @@
 #include <GL/glew.h>
 
 #include <vector>
+#include <algorithm>
+#include <initializer_list>
 
 namespace gge {
 
@@ -15,6 +17,24 @@ struct vertex_flat
 	GLfloat pos[2];
 };
 
+struct vertex_uv
+{
+	vertex_uv(float u, float v)
+	: texuv { u, v }
+	{ }
+
+	GLfloat texuv[2];
+};
+
+struct vertex_color
+{
+	vertex_color(float r, float g, float b)
+	: color { r, g, b }
+	{ }
+
+	GLfloat color[3];
+};
+
 struct vertex_texuv
 {
 	vertex_texuv(float x, float y, float u, float v)
@@ -26,6 +46,22 @@ struct vertex_texuv
 	GLfloat texuv[2];
 };
 
+// Locations of the vertex attributes, bound by every gge::program before
+// linking so vertex formats can point at them without looking them up.
+
+namespace attribute {
+
+enum : GLuint
+{
+	POSITION,
+	TEXUV,
+	COLOR,
+
+	NUM_ATTRIBUTES
+};
+
+}
+
 namespace detail {
 
 // RAII <3 <3 <3
@@ -38,13 +74,13 @@ struct client_state<vertex_flat>
 {
 	client_state(const vertex_flat *verts)
 	{
-		glEnableClientState(GL_VERTEX_ARRAY);
-		glVertexPointer(2, GL_FLOAT, sizeof *verts, verts->pos);
+		glEnableVertexAttribArray(attribute::POSITION);
+		glVertexAttribPointer(attribute::POSITION, 2, GL_FLOAT, GL_FALSE, sizeof *verts, verts->pos);
 	}
 
 	~client_state()
 	{
-		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableVertexAttribArray(attribute::POSITION);
 	}
 };
 
@@ -53,20 +89,81 @@ struct client_state<vertex_texuv>
 {
 	client_state(const vertex_texuv *verts)
 	{
-		glEnableClientState(GL_VERTEX_ARRAY);
-		glVertexPointer(2, GL_FLOAT, sizeof *verts, verts->pos);
+		glEnableVertexAttribArray(attribute::POSITION);
+		glVertexAttribPointer(attribute::POSITION, 2, GL_FLOAT, GL_FALSE, sizeof *verts, verts->pos);
 
-		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-		glTexCoordPointer(2, GL_FLOAT, sizeof *verts, verts->texuv);
+		glEnableVertexAttribArray(attribute::TEXUV);
+		glVertexAttribPointer(attribute::TEXUV, 2, GL_FLOAT, GL_FALSE, sizeof *verts, verts->texuv);
 	}
 
 	~client_state()
 	{
-		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableVertexAttribArray(attribute::TEXUV);
+		glDisableVertexAttribArray(attribute::POSITION);
+	}
+};
+
+// Two triangles per quad, 0 1 3 and 1 2 3 from the quad's first vertex, in
+// one element buffer shared by everything drawn as quads. Deformed quads
+// come out different depending on the diagonal; this is the one GL_QUADS
+// got split along, so they look the same as they did. The indices are
+// 16 bit, the only size every GLES 2 takes, so a draw covers at most
+// MAX_QUADS quads.
+
+class quad_indices
+{
+public:
+	static constexpr size_t MAX_QUADS = 65536/4;
+
+	// binds the buffer to GL_ELEMENT_ARRAY_BUFFER, grown to hold at least
+	// num_quads quads
+
+	static void bind(size_t num_quads)
+	{
+		static quad_indices instance;
+		instance.reserve(num_quads);
+	}
+
+	static void unbind()
+	{ glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); }
+
+private:
+	quad_indices()
+	: num_quads_(0)
+	{ glGenBuffers(1, &id_); }
+
+	void reserve(size_t num_quads)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id_);
+
+		if (num_quads <= num_quads_)
+			return;
+
+		num_quads_ = std::min(std::max(num_quads, 2*num_quads_), MAX_QUADS);
+
+		std::vector<GLushort> indices;
+		indices.reserve(6*num_quads_);
+
+		for (size_t i = 0; i < num_quads_; i++) {
+			const GLushort v = 4*i;
+
+			for (GLushort j : { 0, 1, 3, 1, 2, 3 })
+				indices.push_back(v + j);
+		}
+
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
 	}
+
+	GLuint id_;
+	size_t num_quads_;
 };
 
+inline void
+draw_quad_indices(size_t num_quads)
+{
+	glDrawElements(GL_TRIANGLES, 6*num_quads, GL_UNSIGNED_SHORT, nullptr);
+}
+
 } // detail
 
 template <class Vertex>
@@ -84,6 +181,23 @@ public:
 		detail::client_state<Vertex> state(&this->front());
 		glDrawArrays(mode, 0, this->size());
 	}
+
+	// every 4 vertices are a quad, drawn as two triangles
+
+	void draw_quads() const
+	{
+		const size_t num_quads = this->size()/4;
+
+		for (size_t first = 0; first < num_quads; first += detail::quad_indices::MAX_QUADS) {
+			const size_t count = std::min(num_quads - first, detail::quad_indices::MAX_QUADS);
+
+			detail::client_state<Vertex> state(&(*this)[4*first]);
+			detail::quad_indices::bind(count);
+			detail::draw_quad_indices(count);
+		}
+
+		detail::quad_indices::unbind();
+	}
 };
 
 using vertex_array_flat = vertex_array<vertex_flat>;
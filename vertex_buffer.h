@@ -0,0 +1,289 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "vertex_array.h"
+
+namespace gge {
+
+namespace detail {
+
+// attribute setup for a vertex type read from the currently bound
+// GL_ARRAY_BUFFER, starting at byte offset
+
+inline void
+enable_attribute(GLuint location, GLint size, GLsizei stride, size_t offset)
+{
+	glEnableVertexAttribArray(location);
+	glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid *>(offset));
+}
+
+template <typename VertexType>
+struct buffer_attributes;
+
+template <>
+struct buffer_attributes<vertex_flat>
+{
+	static void enable(size_t offset)
+	{ enable_attribute(attribute::POSITION, 2, sizeof(vertex_flat), offset); }
+
+	static void disable()
+	{ glDisableVertexAttribArray(attribute::POSITION); }
+};
+
+template <>
+struct buffer_attributes<vertex_uv>
+{
+	static void enable(size_t offset)
+	{ enable_attribute(attribute::TEXUV, 2, sizeof(vertex_uv), offset); }
+
+	static void disable()
+	{ glDisableVertexAttribArray(attribute::TEXUV); }
+};
+
+template <>
+struct buffer_attributes<vertex_color>
+{
+	static void enable(size_t offset)
+	{ enable_attribute(attribute::COLOR, 3, sizeof(vertex_color), offset); }
+
+	static void disable()
+	{ glDisableVertexAttribArray(attribute::COLOR); }
+};
+
+class buffer_object
+{
+public:
+	buffer_object(GLenum target = GL_ARRAY_BUFFER)
+	: target_(target)
+	{ glGenBuffers(1, &id_); }
+
+	~buffer_object()
+	{ glDeleteBuffers(1, &id_); }
+
+	GLenum get_target() const
+	{ return target_; }
+
+	GLuint get_id() const
+	{ return id_; }
+
+	void bind() const
+	{ glBindBuffer(target_, id_); }
+
+	// client side vertex_arrays need this to be unbound
+
+	void unbind() const
+	{ glBindBuffer(target_, 0); }
+
+private:
+	buffer_object(const buffer_object&) = delete;
+	buffer_object& operator=(const buffer_object&) = delete;
+
+	GLenum target_;
+	GLuint id_;
+};
+
+// Data uploaded once and only ever appended to afterwards, until cleared.
+// A copy is kept on the CPU side so the buffer can be regrown without
+// reading it back.
+
+template <typename T>
+class static_buffer
+{
+public:
+	static_buffer(GLenum target)
+	: buffer_(target)
+	, capacity_(0)
+	{ }
+
+	template <typename Iterator>
+	void append(Iterator first, Iterator last)
+	{
+		const size_t offset = data_.size();
+		data_.insert(data_.end(), first, last);
+
+		buffer_.bind();
+
+		if (data_.size() > capacity_) {
+			capacity_ = std::max<size_t>(2*capacity_, data_.size());
+			glBufferData(buffer_.get_target(), capacity_*sizeof(T), nullptr, GL_STATIC_DRAW);
+			glBufferSubData(buffer_.get_target(), 0, data_.size()*sizeof(T), &data_[0]);
+		} else {
+			glBufferSubData(buffer_.get_target(), offset*sizeof(T), (data_.size() - offset)*sizeof(T), &data_[offset]);
+		}
+
+		buffer_.unbind();
+	}
+
+	// keeps the storage, the next append() writes over it
+
+	void clear()
+	{ data_.clear(); }
+
+	size_t size() const
+	{ return data_.size(); }
+
+protected:
+	buffer_object buffer_;
+
+private:
+	std::vector<T> data_;
+	size_t capacity_;
+};
+
+} // detail
+
+// Vertex data that only changes when appended to or cleared.
+
+template <class Vertex>
+class static_vertex_buffer : public detail::static_buffer<Vertex>
+{
+public:
+	static_vertex_buffer()
+	: detail::static_buffer<Vertex>(GL_ARRAY_BUFFER)
+	{ }
+
+	// attributes start at vertex first
+
+	void enable(size_t first = 0) const
+	{
+		this->buffer_.bind();
+		detail::buffer_attributes<Vertex>::enable(first*sizeof(Vertex));
+		this->buffer_.unbind();
+	}
+
+	void disable() const
+	{ detail::buffer_attributes<Vertex>::disable(); }
+};
+
+// 16 bit element indices that only change when appended to or cleared.
+// Stays bound to GL_ELEMENT_ARRAY_BUFFER from bind() to unbind(), for
+// drawing with offsets into it.
+
+class static_index_buffer : public detail::static_buffer<GLushort>
+{
+public:
+	static_index_buffer()
+	: detail::static_buffer<GLushort>(GL_ELEMENT_ARRAY_BUFFER)
+	{ }
+
+	void bind() const
+	{ buffer_.bind(); }
+
+	void unbind() const
+	{ buffer_.unbind(); }
+};
+
+// Texels of a gge::buffer_texture that only change when appended to or
+// cleared. Needs GL 3.1, see gge::buffer_texture::is_supported().
+
+template <typename T>
+class static_texel_buffer : public detail::static_buffer<T>
+{
+public:
+	static_texel_buffer()
+	: detail::static_buffer<T>(GL_TEXTURE_BUFFER)
+	{ }
+
+	GLuint get_id() const
+	{ return this->buffer_.get_id(); }
+};
+
+// Ring buffer for vertex data rewritten every frame. Each frame gets a
+// fresh region mapped unsynchronized, so the GPU can still be reading the
+// previous ones; when the ring wraps the whole buffer is orphaned and the
+// driver hands back new storage instead of stalling.
+
+template <class Vertex>
+class stream_vertex_buffer
+{
+public:
+	stream_vertex_buffer(size_t capacity)
+	: capacity_(capacity)
+	, offset_(0)
+	, size_(0)
+	{
+		buffer_.bind();
+		glBufferData(GL_ARRAY_BUFFER, capacity_*sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+		buffer_.unbind();
+	}
+
+	Vertex *map(size_t count)
+	{
+		buffer_.bind();
+
+		offset_ += size_;
+		size_ = count;
+
+		if (offset_ + count > capacity_) {
+			capacity_ = std::max(capacity_, 2*count);
+			glBufferData(GL_ARRAY_BUFFER, capacity_*sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+			offset_ = 0;
+		}
+
+		if (GLEW_ARB_map_buffer_range) {
+			Vertex *verts = static_cast<Vertex *>(glMapBufferRange(
+						GL_ARRAY_BUFFER,
+						offset_*sizeof(Vertex), count*sizeof(Vertex),
+						GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+			buffer_.unbind();
+			return verts;
+		} else {
+			// no unsynchronized mapping, write to a staging copy and
+			// upload it on unmap
+			staging_.resize(count, Vertex { 0, 0 });
+			return &staging_[0];
+		}
+	}
+
+	void unmap()
+	{
+		buffer_.bind();
+
+		if (GLEW_ARB_map_buffer_range)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		else
+			glBufferSubData(GL_ARRAY_BUFFER, offset_*sizeof(Vertex), size_*sizeof(Vertex), &staging_[0]);
+
+		buffer_.unbind();
+	}
+
+	// attributes point at the region written by the last map(), from its
+	// vertex first on
+
+	void enable(size_t first = 0) const
+	{
+		buffer_.bind();
+		detail::buffer_attributes<Vertex>::enable((offset_ + first)*sizeof(Vertex));
+		buffer_.unbind();
+	}
+
+	void disable() const
+	{ detail::buffer_attributes<Vertex>::disable(); }
+
+	// for reading the buffer some other way than through attributes; the
+	// name stays the same when the storage is orphaned or regrown
+
+	GLuint get_id() const
+	{ return buffer_.get_id(); }
+
+	// first vertex of the region written by the last map()
+
+	size_t get_offset() const
+	{ return offset_; }
+
+	size_t get_capacity() const
+	{ return capacity_; }
+
+private:
+	detail::buffer_object buffer_;
+	size_t capacity_;
+	size_t offset_;
+	size_t size_;
+	std::vector<Vertex> staging_;
+};
+
+} // gge
@@ -1,668 +1,913 @@
-#include <GL/glew.h>
-
-#include <map>
-#include <set>
 #include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <random>
+#include <unordered_map>
 
-#include <cmath>
 #include <cassert>
 
 #include "vec2.h"
-#include "vertex_array.h"
-#include "piece_pattern.h"
-#include "texture.h"
+#include "particles.h"
+#include "broad_phase.h"
+#include "islands.h"
+#include "occupancy.h"
+#include "thread_pool.h"
+#include "profiler.h"
+#include "replay.h"
+#include "object_pool.h"
+#include "piece.h"
 #include "world.h"
 
 namespace {
-constexpr auto GRAVITY = 1.f;
-constexpr auto DAMPING = .75f;
-constexpr auto FRICTION = .6f;
-
 constexpr auto SPAWN_INTERVAL = 30;
 
-constexpr auto BLOCK_SIZE = 20;
-}
+constexpr auto BROAD_PHASE_MARGIN = .5f*BLOCK_SIZE;
+constexpr auto BROAD_PHASE_CELL_SIZE = 2.f*BLOCK_SIZE;
 
-struct body
-{
-	body(const vec2& position)
-	: position(position)
-	, prev_position(position)
-	{ }
+// an awake piece moving faster than WAKE_MOTION wakes up any sleeping piece
+// it touches
 
-	void update_position();
+constexpr auto WAKE_MOTION = 1.5f;
 
-	vec2 position;
-	vec2 prev_position;
-};
+// a piece stepping farther than this is collided along the way, so it can't
+// pass through a block; well under half a block, so a push out of a block
+// it runs into is always back the way it came
+constexpr auto MAX_STEP = .25f*BLOCK_SIZE;
 
-using body_ptr = std::shared_ptr<body>;
+constexpr auto ISLANDS_PER_JOB = 1;
 
-struct spring
-{
-	spring(vec2& p0, vec2& p1)
-	: p0(p0)
-	, p1(p1)
-	, rest_length((p0 - p1).length())
-	{ }
+// rows cleared by clear_rows are a block high, rasterized in cells a quarter
+// of a block wide; a row is full once FULL_ROW of its cells are covered
+constexpr auto OCCUPANCY_CELLS_PER_ROW = 4;
+constexpr auto OCCUPANCY_CELL_SIZE = static_cast<float>(BLOCK_SIZE)/OCCUPANCY_CELLS_PER_ROW;
+constexpr auto OCCUPANCY_WALL_GAP = .5f*BLOCK_SIZE;
+constexpr auto FULL_ROW = .85f;
 
-	vec2 &p0, &p1;
-	float rest_length;
-};
+// particles are compacted once more than this fraction of them belong to
+// removed pieces
+constexpr auto MAX_DEAD_PARTICLES = .5f;
 
-struct quad
+uint64_t
+get_pair_key(const proxy_pair& p)
 {
-	vec2 &p0, uv0;
-	vec2 &p1, uv1;
-	vec2 &p2, uv2;
-	vec2 &p3, uv3;
-};
+	return static_cast<uint64_t>(p.first) << 32 | p.second;
+}
+
+// the blocks of a piece_topology::blocks mask connected by their sides to
+// the lowest one in it
 
-class quad_collision
+uint32_t
+get_connected_blocks(uint32_t blocks)
 {
-public:
-	quad_collision(quad& t0, quad& t1)
-	: t0_(t0), t1_(t1)
-	{ }
+	uint32_t connected = blocks & (~blocks + 1);
+	uint32_t prev = 0;
 
-	bool operator()();
+	while (connected != prev) {
+		prev = connected;
 
-	const vec2& push_vector() const
-	{ return push_vector_; }
+		for (int i = 0; i < MAX_PIECE_QUADS; i++) {
+			if (!(prev & (1u << i)))
+				continue;
 
-private:
-	template <bool First>
-	bool separating_axis_test(const vec2& from, const vec2& to);
+			const int row = i/MAX_PIECE_COLS;
+			const int col = i%MAX_PIECE_COLS;
 
-	quad &t0_, &t1_;
-	vec2 push_vector_;
-};
+			if (col > 0)
+				connected |= 1u << (i - 1);
 
-class piece;
-using piece_ptr = std::shared_ptr<piece>;
+			if (col + 1 < MAX_PIECE_COLS)
+				connected |= 1u << (i + 1);
 
-class piece
-{
-public:
-	piece(const piece& other);
-	piece(const piece_pattern& pattern);
+			if (row > 0)
+				connected |= 1u << (i - MAX_PIECE_COLS);
 
-	void draw() const;
+			if (row + 1 < MAX_PIECE_ROWS)
+				connected |= 1u << (i + MAX_PIECE_COLS);
+		}
 
-	void update_positions();
-	void check_constraints(int width, int height);
-	void collide(piece& other);
+		connected &= blocks;
+	}
 
-	void move(const vec2& p);
+	return connected;
+}
 
-private:
-	void update_bounding_box();
-
-	rgb color_;
-	std::shared_ptr<gge::texture> texture_;
-	std::vector<body> bodies_;
-	std::vector<spring> springs_;
-	std::vector<quad> quads_;
-	vec2 min_pos_, max_pos_;
-};
+// adds the time between construction and destruction to a world_timings
+// field and to the profiler section
 
-class piece_factory
+class phase_timer
 {
 public:
-	static piece_factory& get_instance();
-
-	piece_ptr make_piece(int type) const;
+	phase_timer(double& total, profile_section section)
+	: total_(total)
+	, section_(section)
+	, start_(profiler::clock::now())
+	{ }
 
-	size_t get_num_types() const
-	{ return pieces_.size(); }
+	~phase_timer()
+	{
+		const auto end = profiler::clock::now();
+		total_ += std::chrono::duration<double, std::milli>(end - start_).count();
+		profiler::get_instance().add_time(section_, start_, end);
+	}
 
 private:
-	piece_factory();
-
-	std::vector<piece_ptr> pieces_;
-
-	piece_factory(const piece_factory&) = delete;
-	piece_factory& operator=(const piece_factory&) = delete;
+	double& total_;
+	profile_section section_;
+	profiler::clock::time_point start_;
 };
+}
 
 class world_impl
 {
 public:
-	world_impl(int width, int height);
+	world_impl(int width, int height, const world_options& options);
 
-	void draw() const;
 	void update();
 
+	uint32_t get_num_updates() const
+	{ return num_updates_; }
+
+	int get_width() const
+	{ return width_; }
+
+	int get_height() const
+	{ return height_; }
+
+	const container& get_walls() const
+	{ return walls_; }
+
+	size_t get_num_pieces() const
+	{ return pieces_.size(); }
+
+	uint32_t get_layout() const
+	{ return layout_; }
+
+	size_t get_num_slots() const
+	{ return pieces_.get_num_slots(); }
+
+	void get_topologies(size_t first_slot, std::vector<const piece_topology *>& topologies) const;
+	void publish(world_snapshot& s) const;
+
+	const world_timings& get_timings() const
+	{ return timings_; }
+
+	void reset_timings()
+	{ timings_ = world_timings(); }
+
 private:
-	void draw_walls() const;
+	// milliseconds a solver thread spent on each part of solving islands,
+	// padded to a cache line so threads don't share one
+	struct solve_times
+	{
+		double springs, walls, collide;
+		char padding[64 - 3*sizeof(double)];
+	};
 
-	std::vector<piece_ptr> pieces_;
+	void update_broad_phase();
+	void find_pairs();
+	void build_islands();
+	void prune_contact_caches();
+	void substep_fast_pieces();
+	void wake_pieces();
+	bool update_sleep_states();
+	size_t add_piece(const piece_topology& topology);
+	void remove_piece(size_t index);
+	void remove_blocks(size_t index, uint32_t blocks);
+	void clear_full_rows();
+	void compact_particles();
+	void spawn_piece(int type, int x);
+	void spawn_random_piece();
+	void play_back_events();
+	void solve_island(size_t island, solve_times& times);
+	float get_island_error(size_t island) const;
+
+	particle_store particles_;
+	size_t dead_particles_; // in particles_, of removed pieces
+	object_pool<piece> pieces_; // slot index is the broad phase proxy id
+	uint32_t layout_;
+	std::unique_ptr<broad_phase> broad_phase_;
+	std::vector<proxy_pair> pairs_;
+	std::vector<proxy_pair> awake_pairs_;
+	std::vector<size_t> awake_pieces_;
+	island_set islands_;
+	thread_pool thread_pool_;
+	std::vector<solve_times> solve_times_; // one per solver thread
+
+	// contact caches of pairs that touched in the last update, keyed by
+	// proxy pair; island_contacts_ is parallel to islands_.pairs
+	struct cached_contacts
+	{
+		contact_cache cache;
+		uint32_t last_update;
+	};
+	std::unordered_map<uint64_t, cached_contacts> contact_caches_;
+	std::vector<contact_cache *> island_contacts_;
+
+	// scratch space for substep_fast_pieces()
+	std::vector<size_t> neighbors_;
+	std::vector<vec2> substep_deltas_;
+
+	container walls_;
+	occupancy_grid occupancy_;
+	std::vector<uint8_t> full_rows_; // parallel to the rows of occupancy_
+	bool clear_rows_;
+	bool allow_sleeping_;
+	size_t max_pieces_;
+	solver_options solver_;
+
+	// mt19937 output is fully specified, so the piece stream for a seed is
+	// the same everywhere
+	std::mt19937 rng_;
+	replay_log *record_;
+	const replay_log *playback_;
+	size_t next_event_;
+	uint32_t num_updates_;
 
 	int spawn_tic_;
 	int width_;
 	int height_;
-	gge::vertex_array_flat wall_va_;
+	world_timings timings_;
 };
 
-
 //
-//  b o d y
+//  w o r l d _ s n a p s h o t
 //
 
 void
-body::update_position()
+world_snapshot::get_body_positions(float *out, float alpha) const
 {
-	vec2 speed = DAMPING*(position - prev_position);
-	prev_position = position;
-	position += speed + vec2(0, -GRAVITY);
+	for (size_t i = 0; i < xy.size(); i++)
+		out[i] = prev_xy[i] + alpha*(xy[i] - prev_xy[i]);
 }
 
 //
-//  q u a d _ c o l l i s i o n
+//  w o r l d
 //
 
-static std::pair<float, float>
-project_quad_to_axis(const vec2& dir, const quad& t)
-{
-	float t0 = dir.dot(t.p0);
-	float t1 = dir.dot(t.p1);
-	float t2 = dir.dot(t.p2);
-	float t3 = dir.dot(t.p3);
-
-	float min = std::min(t0, std::min(t1, std::min(t2, t3)));
-	float max = std::max(t0, std::max(t1, std::max(t2, t3)));
+world_impl::world_impl(int width, int height, const world_options& options)
+: dead_particles_(0)
+, layout_(0)
+, broad_phase_(make_broad_phase(options.broad_phase, BROAD_PHASE_MARGIN, BROAD_PHASE_CELL_SIZE))
+, thread_pool_(options.num_threads)
+, solve_times_(thread_pool_.get_num_threads())
+, walls_(options.walls ? *options.walls : container::make_bowl(width, height))
+, occupancy_(walls_, OCCUPANCY_CELL_SIZE, OCCUPANCY_CELLS_PER_ROW, OCCUPANCY_WALL_GAP)
+, clear_rows_(options.clear_rows)
+, allow_sleeping_(options.allow_sleeping)
+, max_pieces_(options.max_pieces)
+, solver_(options.solver)
+, rng_(options.seed)
+, record_(options.record)
+, playback_(options.playback)
+, next_event_(0)
+, num_updates_(0)
+, spawn_tic_(SPAWN_INTERVAL)
+, width_(width)
+, height_(height)
+{ }
 
-	return std::make_pair(min, max);
+void
+world_impl::get_topologies(size_t first_slot, std::vector<const piece_topology *>& topologies) const
+{
+	for (size_t i = first_slot; i < pieces_.get_num_slots(); i++) {
+		if (pieces_.is_alive(i))
+			topologies.push_back(&pieces_[i].get_topology());
+	}
 }
 
-template <bool First>
-bool
-quad_collision::separating_axis_test(const vec2& from, const vec2& to)
+void
+world_impl::publish(world_snapshot& s) const
 {
-	vec2 normal = vec2(-(to.y - from.y), to.x - from.x).normalize();
+	if (s.layout != layout_) {
+		s.layout = layout_;
+		s.num_slots = 0;
+		s.topologies.clear();
+	}
 
-	std::pair<float, float> s0 = project_quad_to_axis(normal, t0_);
-	std::pair<float, float> s1 = project_quad_to_axis(normal, t1_);
+	if (s.num_slots < pieces_.get_num_slots()) {
+		get_topologies(s.num_slots, s.topologies);
+		s.num_slots = pieces_.get_num_slots();
+	}
 
-	static const float EPSILON = 1e-5;
+	size_t num_bodies = 0;
 
-	if (s0.second < s1.first + EPSILON || s1.second < s0.first + EPSILON)
-		return true;
+	pieces_.for_each([&] (const piece& p) { num_bodies += p.get_num_particles(); });
 
-	// update push_vector_
+	s.prev_xy.resize(2*num_bodies);
+	s.xy.resize(2*num_bodies);
 
-	float push_length;
+	size_t offset = 0;
 
-	if (s0.second - s1.first < s1.second - s0.first) {
-		push_length = s0.second - s1.first;
-	} else {
-		normal = -normal;
-		push_length = s1.second - s0.first;
-	}
+	pieces_.for_each([&] (const piece& p) {
+		p.write_states(&s.prev_xy[offset], &s.xy[offset]);
+		offset += 2*p.get_num_particles();
+	});
+
+	s.update = num_updates_;
+}
 
-	push_length *= .5*FRICTION;
+void
+world_impl::update_broad_phase()
+{
+	bool moved = false;
 
-	if (First || push_length*push_length < push_vector_.length_squared())
-		push_vector_ = normal*(push_length/normal.length());
+	for (size_t i = 0; i < pieces_.get_num_slots(); i++) {
+		if (pieces_.is_alive(i) && broad_phase_->move_proxy(i, pieces_[i].get_bounding_box()))
+			moved = true;
+	}
 
-	return false;
+	if (moved)
+		find_pairs();
 }
 
-bool
-quad_collision::operator()()
+void
+world_impl::find_pairs()
 {
-	if (separating_axis_test<true>(t0_.p0, t0_.p1))
-		return false;
-
-	if (separating_axis_test<false>(t0_.p1, t0_.p2))
-		return false;
+	broad_phase_->find_pairs(pairs_);
+	build_islands();
+}
 
-	if (separating_axis_test<false>(t0_.p2, t0_.p3))
-		return false;
+void
+world_impl::build_islands()
+{
+	// two sleeping pieces don't need to be tested against each other
 
-	if (separating_axis_test<false>(t0_.p3, t0_.p0))
-		return false;
+	awake_pairs_.clear();
 
-	if (separating_axis_test<false>(t1_.p0, t1_.p1))
-		return false;
+	for (auto& i : pairs_) {
+		if (!pieces_[i.first].is_sleeping() || !pieces_[i.second].is_sleeping())
+			awake_pairs_.push_back(i);
+	}
 
-	if (separating_axis_test<false>(t1_.p1, t1_.p2))
-		return false;
+	awake_pieces_.clear();
 
-	if (separating_axis_test<false>(t1_.p2, t1_.p3))
-		return false;
+	for (size_t i = 0; i < pieces_.get_num_slots(); i++) {
+		if (pieces_.is_alive(i) && !pieces_[i].is_sleeping())
+			awake_pieces_.push_back(i);
+	}
 
-	if (separating_axis_test<false>(t1_.p3, t1_.p0))
-		return false;
+	islands_.build(pieces_.get_num_slots(), awake_pieces_, awake_pairs_);
 
-	t0_.p0 -= push_vector_;
-	t0_.p1 -= push_vector_;
-	t0_.p2 -= push_vector_;
-	t0_.p3 -= push_vector_;
+	// element pointers survive rehashing, so these stay valid until pruned
 
-	t1_.p0 += push_vector_;
-	t1_.p1 += push_vector_;
-	t1_.p2 += push_vector_;
-	t1_.p3 += push_vector_;
+	island_contacts_.clear();
 
-	return true;
+	for (auto& i : islands_.pairs) {
+		cached_contacts& c = contact_caches_[get_pair_key(i)];
+		c.last_update = num_updates_;
+		island_contacts_.push_back(&c.cache);
+	}
 }
 
+void
+world_impl::prune_contact_caches()
+{
+	for (auto& i : islands_.pairs)
+		contact_caches_[get_pair_key(i)].last_update = num_updates_;
+
+	for (auto it = contact_caches_.begin(); it != contact_caches_.end();) {
+		if (it->second.last_update != num_updates_)
+			it = contact_caches_.erase(it);
+		else
+			++it;
+	}
+}
 
-//
-//  p i e c e
-//
-
-piece::piece(const piece_pattern& pattern)
-: color_(pattern.color)
-, texture_(make_piece_texture(pattern))
+void
+world_impl::substep_fast_pieces()
 {
-	texture_->set_wrap_s(GL_CLAMP);
-	texture_->set_wrap_t(GL_CLAMP);
+	for (size_t i = 0; i < pieces_.get_num_slots(); i++) {
+		if (!pieces_.is_alive(i) || pieces_[i].is_sleeping())
+			continue;
 
-	texture_->set_mag_filter(GL_LINEAR);
-	texture_->set_min_filter(GL_LINEAR);
+		piece& p = pieces_[i];
 
-	texture_->set_env_mode(GL_MODULATE);
+		const float step = p.get_step_length();
 
-	std::map<std::pair<int, int>, body *> body_map;
-	std::set<std::pair<vec2 *, vec2 *>> spring_set;
+		if (step <= MAX_STEP)
+			continue;
 
-	auto add_body = [&] (int i, int j) -> body * {
-		auto it = body_map.find(std::make_pair(i, j));
+		const int num_substeps = ceilf(step/MAX_STEP);
 
-		if (it == body_map.end()) {
-			bodies_.push_back(body(vec2(j*BLOCK_SIZE, i*BLOCK_SIZE)));
-			it = body_map.insert(it, std::make_pair(std::make_pair(i, j), &bodies_.back()));
-		}
+		// anything it could run into on the way
 
-		return it->second;
-	};
+		const aabb box = p.get_bounding_box();
+		const aabb swept { box.min - vec2(step, step), box.max + vec2(step, step) };
 
-	auto add_spring = [&] (vec2& v0, vec2& v1) {
-		if (spring_set.find(std::make_pair(&v0, &v1)) != spring_set.end())
-			return;
+		neighbors_.clear();
 
-		if (spring_set.find(std::make_pair(&v1, &v0)) != spring_set.end())
-			return;
+		for (size_t j = 0; j < pieces_.get_num_slots(); j++) {
+			if (j != i && pieces_.is_alive(j) && pieces_[j].get_bounding_box().overlaps(swept))
+				neighbors_.push_back(j);
+		}
 
-		springs_.push_back(spring(v0, v1));
-		spring_set.insert(std::make_pair(&v0, &v1));
-	};
+		if (neighbors_.empty())
+			continue;
 
-	bodies_.reserve((MAX_PIECE_ROWS + 1)*(MAX_PIECE_COLS + 1));
+		p.substep(num_substeps, substep_deltas_, [&] {
+			for (auto j : neighbors_) {
+				const proxy_pair pair = std::minmax(i, j);
+				pieces_[pair.first].collide(pieces_[pair.second], contact_caches_[get_pair_key(pair)].cache);
+			}
+		});
 
-	const float du = static_cast<float>(texture_->get_orig_width())/texture_->get_width()/MAX_PIECE_COLS;
-	const float dv = static_cast<float>(texture_->get_orig_height())/texture_->get_height()/MAX_PIECE_ROWS;
+		profiler::get_instance().add_count(profile_counter::SUBSTEPS, num_substeps);
+	}
+}
 
-	for (int i = 0; i < MAX_PIECE_ROWS; i++) {
-		for (int j = 0; j < MAX_PIECE_COLS; j++) {
-			if (pattern.pattern[i][j] != '#')
-				continue;
+void
+world_impl::wake_pieces()
+{
+	bool woke = false;
 
-			// bodies
+	for (auto& i : pairs_) {
+		piece& p0 = pieces_[i.first];
+		piece& p1 = pieces_[i.second];
 
-			body *b0 = add_body(i, j);
-			body *b1 = add_body(i, j + 1);
-			body *b2 = add_body(i + 1, j + 1);
-			body *b3 = add_body(i + 1, j);
+		if (p0.is_sleeping() == p1.is_sleeping())
+			continue;
 
-			// springs
+		const piece& awake = p0.is_sleeping() ? p1 : p0;
+		piece& sleeping = p0.is_sleeping() ? p0 : p1;
 
-			vec2& v0 = b0->position;
-			vec2& v1 = b1->position;
-			vec2& v2 = b2->position;
-			vec2& v3 = b3->position;
+		if (awake.get_motion() > WAKE_MOTION && awake.get_bounding_box().overlaps(sleeping.get_bounding_box())) {
+			sleeping.wake();
+			woke = true;
+		}
+	}
 
-			add_spring(v0, v1);
-			add_spring(v1, v2);
-			add_spring(v2, v3);
-			add_spring(v3, v0);
+	if (woke)
+		build_islands();
+}
 
-			add_spring(v0, v2);
-			add_spring(v1, v3);
+bool
+world_impl::update_sleep_states()
+{
+	bool slept = false;
 
-			// quads
+	pieces_.for_each([&] (piece& p) {
+		if (p.is_sleeping())
+			return;
 
-			const float u = du*j;
-			const float v = dv*i;
+		p.update_sleep_state();
 
-			quads_.push_back(quad{v0, {u, v}, v1, {u + du, v}, v2, {u + du, v + dv}, v3, {u, v + dv}});
-		}
-	}
+		if (p.is_sleeping())
+			slept = true;
+	});
 
-	update_bounding_box();
+	if (slept)
+		build_islands();
 
-	printf("%lu bodies, %lu springs, %lu quads\n", bodies_.size(), springs_.size(), quads_.size());
+	return slept;
 }
 
-piece::piece(const piece& other)
-: color_(other.color_)
-, texture_(other.texture_)
-, bodies_(other.bodies_)
-, min_pos_(other.min_pos_)
-, max_pos_(other.max_pos_)
+float
+world_impl::get_island_error(size_t island) const
 {
-	std::map<const vec2 *, size_t> pos_body;
+	float error = 0;
 
-	for (size_t i = 0; i < other.bodies_.size(); i++)
-		pos_body[&other.bodies_[i].position] = i;
+	for (size_t i = islands_.proxy_offsets[island]; i < islands_.proxy_offsets[island + 1]; i++) {
+		const piece& p = pieces_[islands_.proxies[i]];
 
-	for (auto& i : other.springs_) {
-		vec2& p0 = bodies_[pos_body[&i.p0]].position;
-		vec2& p1 = bodies_[pos_body[&i.p1]].position;
-		springs_.push_back(spring(p0, p1));
+		if (!p.is_sleeping())
+			error = std::max(error, p.get_solver_error());
 	}
 
-	for (auto& i : other.quads_) {
-		vec2& p0 = bodies_[pos_body[&i.p0]].position;
-		vec2& p1 = bodies_[pos_body[&i.p1]].position;
-		vec2& p2 = bodies_[pos_body[&i.p2]].position;
-		vec2& p3 = bodies_[pos_body[&i.p3]].position;
-		quads_.push_back(quad{p0, i.uv0, p1, i.uv1, p2, i.uv2, p3, i.uv3});
-	}
+	return error;
 }
 
-void
-piece::update_positions()
-{
-	for (auto& i : bodies_)
-		i.update_position();
-
-	update_bounding_box();
-}
+// passes of springs, walls and contacts over the pieces of an island until
+// it converges, independently of every other island; what each part took
+// is added to times
 
 void
-piece::check_constraints(int width, int height)
+world_impl::solve_island(size_t island, solve_times& times)
 {
-	// springs
+	const size_t first_piece = islands_.proxy_offsets[island];
+	const size_t last_piece = islands_.proxy_offsets[island + 1];
+	const size_t first_pair = islands_.pair_offsets[island];
+	const size_t last_pair = islands_.pair_offsets[island + 1];
 
-	for (auto& i : springs_) {
-		vec2& p0 = i.p0;
-		vec2& p1 = i.p1;
+	using ms = std::chrono::duration<double, std::milli>;
 
-		vec2 dir = p1 - p0;
+	auto start = profiler::clock::now();
 
-		float l = dir.length();
-		float f = .5*(l - i.rest_length)/l;
+	const int budget = std::max(
+		solver_.min_iterations,
+		std::min<int>(solver_.max_iterations, solver_.base_iterations + solver_.contact_iterations*(last_pair - first_pair)));
 
-		p0 += f*dir;
-		p1 -= f*dir;
-	}
+	int passes = 0;
 
-	// body-wall collisions
+	while (passes < budget) {
+		// springs and walls only move the piece's own bodies, so every
+		// piece's springs can go before any walls
 
-	const float bowl_radius = .5*width;
+		for (size_t i = first_piece; i < last_piece; i++) {
+			piece& p = pieces_[islands_.proxies[i]];
 
-	for (auto& i : bodies_) {
-		vec2& p = i.position;
+			if (!p.is_sleeping())
+				p.relax_springs();
+		}
 
-		if (p.y > bowl_radius) {
-			if (p.x < 0)
-				p.x += FRICTION*(-p.x);
+		const auto springs_end = profiler::clock::now();
 
-			if (p.x > width)
-				p.x += FRICTION*(width - p.x);
+		for (size_t i = first_piece; i < last_piece; i++) {
+			piece& p = pieces_[islands_.proxies[i]];
 
-		} else {
-			vec2 d = p - vec2(bowl_radius, bowl_radius);
+			if (!p.is_sleeping())
+				p.constrain_to_walls(walls_);
+		}
 
-			float r = d.length();
+		const auto walls_end = profiler::clock::now();
 
-			if (r > bowl_radius)
-				p -= d*(FRICTION*(r - bowl_radius)/r);
+		for (size_t i = first_pair; i < last_pair; i++) {
+			const proxy_pair& p = islands_.pairs[i];
+			pieces_[p.first].collide(pieces_[p.second], *island_contacts_[i]);
 		}
+
+		const auto collide_end = profiler::clock::now();
+
+		times.springs += ms(springs_end - start).count();
+		times.walls += ms(walls_end - springs_end).count();
+		times.collide += ms(collide_end - walls_end).count();
+
+		start = collide_end;
+
+		if (++passes >= solver_.min_iterations && get_island_error(island) < solver_.tolerance)
+			break;
 	}
 
-	update_bounding_box();
+	profiler::get_instance().add_count(profile_counter::ITERATIONS, passes);
 }
 
-void
-piece::move(const vec2& p)
+// the slot of a new piece, still to be added to the broad phase
+
+size_t
+world_impl::add_piece(const piece_topology& topology)
 {
-	for (auto& i : bodies_) {
-		i.position += p;
-		i.prev_position = i.position;
-	}
+	const auto handle = pieces_.create(topology, particles_);
+
+	// a reused slot comes before pieces that are already drawn
+
+	if (handle.index + 1 < pieces_.get_num_slots())
+		++layout_;
+
+	return handle.index;
 }
 
+// pairs and islands still have the piece until the next find_pairs()
+
 void
-piece::collide(piece& other)
+world_impl::remove_piece(size_t index)
 {
-	// bounding box
+	dead_particles_ += pieces_[index].get_num_particles();
 
-	if (max_pos_.x < other.min_pos_.x)
-		return;
+	broad_phase_->remove_proxy(index);
+	pieces_.destroy(pieces_.get_handle(index));
 
-	if (other.max_pos_.x < min_pos_.x)
-		return;
+	++layout_;
+}
 
-	if (max_pos_.y < other.min_pos_.y)
-		return;
+// whatever is left of the piece goes on as new pieces, one for each group
+// of blocks still connected
 
-	if (other.max_pos_.y < min_pos_.y)
-		return;
+void
+world_impl::remove_blocks(size_t index, uint32_t blocks)
+{
+	const piece& whole = pieces_[index];
+	const piece_topology& topology = whole.get_topology();
 
-	// quads
+	uint32_t left = topology.blocks & ~blocks;
 
-	bool collided = false;
+	while (left) {
+		const uint32_t fragment = get_connected_blocks(left);
+		left &= ~fragment;
 
-	for (auto& q0 : quads_) {
-		for (auto& q1 : other.quads_) {
-			if (quad_collision(q0, q1)())
-				collided = true;
-		}
-	}
+		const size_t i = add_piece(piece_factory::get_instance().get_fragment(topology.type, fragment));
 
-	if (collided) {
-		update_bounding_box();
-		other.update_bounding_box();
+		piece& p = pieces_[i];
+		p.copy_bodies(whole);
+		broad_phase_->add_proxy(i, p.get_bounding_box());
 	}
+
+	remove_piece(index);
 }
 
+// Takes out the blocks of sleeping pieces centered in rows they fill, and
+// wakes everything above the lowest of them so it falls into the gap. A
+// sleeping piece sticking out of the top means the pile overflowed, and
+// takes out every piece.
+
 void
-piece::draw() const
+world_impl::clear_full_rows()
 {
-	glColor3f(color_.r, color_.g, color_.b);
+	occupancy_.clear();
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
+	bool overflowed = false;
 
-	glEnable(GL_TEXTURE_2D);
-	texture_->bind();
+	pieces_.for_each([&] (const piece& p) {
+		if (!p.is_sleeping())
+			return;
 
-	gge::vertex_array_texuv va;
+		if (p.get_bounding_box().max.y > walls_.get_top())
+			overflowed = true;
 
-	va.reserve(4*quads_.size());
+		for (size_t i = 0; i < p.get_num_quads(); i++) {
+			vec2 corners[4];
+			p.get_quad_corners(i, corners);
+			occupancy_.add_quad(corners);
+		}
+	});
 
-	for (auto& i : quads_) {
-		va.push_back({ i.p0.x, i.p0.y, i.uv0.x, i.uv0.y });
-		va.push_back({ i.p1.x, i.p1.y, i.uv1.x, i.uv1.y });
-		va.push_back({ i.p2.x, i.p2.y, i.uv2.x, i.uv2.y });
-		va.push_back({ i.p3.x, i.p3.y, i.uv3.x, i.uv3.y });
-	}
+	const size_t num_slots = pieces_.get_num_slots();
 
-	va.draw(GL_QUADS);
+	if (overflowed) {
+		for (size_t i = 0; i < num_slots; i++) {
+			if (pieces_.is_alive(i))
+				remove_piece(i);
+		}
+	} else {
+		full_rows_.resize(occupancy_.get_num_rows());
 
-	glDisable(GL_TEXTURE_2D);
-	glDisable(GL_BLEND);
-}
+		int lowest_full = -1;
 
-void
-piece::update_bounding_box()
-{
-	assert(!bodies_.empty());
+		for (size_t i = 0; i < full_rows_.size(); i++) {
+			full_rows_[i] = occupancy_.get_fill(i) >= FULL_ROW;
+
+			if (full_rows_[i] && lowest_full == -1)
+				lowest_full = i;
+		}
+
+		if (lowest_full == -1)
+			return;
+
+		// remove_blocks() may put fragments in freed slots anywhere in the
+		// pool, but they start awake, so this loop skips them
+
+		size_t cleared = 0;
+
+		for (size_t i = 0; i < num_slots; i++) {
+			if (!pieces_.is_alive(i) || !pieces_[i].is_sleeping())
+				continue;
+
+			const piece& p = pieces_[i];
+
+			uint32_t blocks = 0;
 
-	min_pos_ = max_pos_ = bodies_[0].position;
+			for (size_t j = 0; j < p.get_num_quads(); j++) {
+				vec2 corners[4];
+				p.get_quad_corners(j, corners);
 
-	std::for_each(
-		bodies_.begin() + 1,
-		bodies_.end(),
-		[this] (const body& b) {
-			min_pos_.x = std::min(min_pos_.x, b.position.x);
-			max_pos_.x = std::max(max_pos_.x, b.position.x);
+				const int row = occupancy_.get_row(.25f*(corners[0].y + corners[1].y + corners[2].y + corners[3].y));
 
-			min_pos_.y = std::min(min_pos_.y, b.position.y);
-			max_pos_.y = std::max(max_pos_.y, b.position.y);
+				if (row != -1 && full_rows_[row])
+					blocks |= 1u << p.get_topology().quad_blocks[j];
+			}
+
+			if (blocks) {
+				remove_blocks(i, blocks);
+				cleared += std::bitset<MAX_PIECE_QUADS>(blocks).count();
+			}
+		}
+
+		const float bottom = occupancy_.get_row_bottom(lowest_full);
+
+		pieces_.for_each([&] (piece& p) {
+			if (p.get_bounding_box().max.y > bottom)
+				p.wake();
 		});
-}
 
-//
-//  p i e c e _ f a c t o r y
-//
+		profiler::get_instance().add_count(profile_counter::BLOCKS_CLEARED, cleared);
+	}
 
-piece_factory&
-piece_factory::get_instance()
-{
-	static piece_factory instance;
-	return instance;
-}
+	find_pairs();
 
-piece_factory::piece_factory()
-{
-	static const piece_pattern patterns[]
-		{
-		{ { "    ",
-		    " ## ",
-		    " ## ",
-		    "    "  },
-		    {0, 0, 1} },
-
-		{ { " #  ",
-		    " #  ",
-		    " #  ",
-		    " #  "  },
-		    {0, 1, 0} },
-
-		{ { " #  ",
-		    " #  ",
-		    " ## ",
-		    "    "  },
-		    {0, 1, 1} },
-
-		{ { "  # ",
-		    "  # ",
-		    " ## ",
-		    "    "  },
-		    {1, 0, 0} },
-
-		{ { " #  ",
-		    " ## ",
-		    " #  ",
-		    "    "  },
-		    {1, 0, 1} },
-
-		{ { " #  ",
-		    " ## ",
-		    "  # ",
-		    "    "  },
-		    {1, 1, 0} },
-
-		{ { "  # ",
-		    " ## ",
-		    " #  ",
-		    "    "  },
-		    {1, 1, 1} } };
-
-	for (auto& i : patterns)
-		pieces_.push_back(std::make_shared<piece>(i));
-}
-
-piece_ptr
-piece_factory::make_piece(int type) const
-{
-	return std::make_shared<piece>(*pieces_[type]);
+	if (dead_particles_ > MAX_DEAD_PARTICLES*particles_.size())
+		compact_particles();
 }
 
-//
-//  w o r l d
-//
+// moves the particles of every piece together in slot order, dropping those
+// of removed pieces
 
-world_impl::world_impl(int width, int height)
-: spawn_tic_(SPAWN_INTERVAL)
-, width_(width)
-, height_(height)
+void
+world_impl::compact_particles()
 {
-	wall_va_.push_back({ 0, static_cast<float>(height_) });
+	particle_store compacted;
+	compacted.reserve(particles_.size() - dead_particles_);
 
-	const float bowl_radius = .5*width_;
+	pieces_.for_each([&] (piece& p) { p.move_particles(compacted); });
 
-	const int NUM_SEGS = 20;
+	particles_ = std::move(compacted);
+	dead_particles_ = 0;
+}
 
-	float a = 0;
-	const float da = M_PI/(NUM_SEGS - 1);
+void
+world_impl::spawn_piece(int type, int x)
+{
+	const size_t index = add_piece(piece_factory::get_instance().get_topology(type));
 
-	for (int i = 0; i < NUM_SEGS; i++) {
-		float x = bowl_radius*(1 - cosf(a));
-		float y = bowl_radius*(1 - sinf(a));
+	piece& p = pieces_[index];
+	p.move(vec2(x, height_));
 
-		wall_va_.push_back({ x, y });
-		a += da;
-	}
+	phase_timer timer(timings_.broad_phase, profile_section::BROAD_PHASE);
 
-	wall_va_.push_back({ static_cast<float>(width_), static_cast<float>(height_) });
+	broad_phase_->add_proxy(index, p.get_bounding_box());
+
+	find_pairs();
 }
 
 void
-world_impl::draw() const
+world_impl::spawn_random_piece()
 {
-	draw_walls();
+	const int type = rng_()%piece_factory::get_instance().get_num_types();
+	const int left = walls_.get_left();
+	const int right = walls_.get_right();
+	const int x = left + rng_()%(right - left - BLOCK_SIZE*MAX_PIECE_COLS);
+
+	spawn_piece(type, x);
 
-	for (auto& i : pieces_)
-		i->draw();
+	if (record_)
+		record_->add_spawn(num_updates_, type, x);
 }
 
 void
-world_impl::draw_walls() const
+world_impl::play_back_events()
 {
-	glColor3f(1, 1, 1);
-	wall_va_.draw(GL_LINE_LOOP);
+	const std::vector<replay_event>& events = playback_->get_events();
+
+	for (; next_event_ < events.size() && events[next_event_].update == num_updates_; ++next_event_) {
+		const replay_event& e = events[next_event_];
+
+		switch (e.kind) {
+			case replay_event::type::SPAWN:
+				if (e.piece_type < piece_factory::get_instance().get_num_types())
+					spawn_piece(e.piece_type, e.x);
+				break;
+		}
+	}
 }
 
 void
 world_impl::update()
 {
+	profile_scope scope(profile_section::UPDATE);
+
 	if (!pieces_.empty()) {
-		for (auto& i : pieces_)
-			i->update_positions();
+		wake_pieces();
 
-		static const int NUM_ITERATIONS = 30;
+		{
+			phase_timer timer(timings_.integrate, profile_section::INTEGRATE);
 
-		for (int i = 0; i < NUM_ITERATIONS; i++) {
-			for (auto& i : pieces_)
-				i->check_constraints(width_, height_);
+			pieces_.for_each([] (piece& p) {
+				if (!p.is_sleeping())
+					p.update_positions();
+			});
+		}
 
-			for (size_t j = 0; j < pieces_.size() - 1; j++)
-				for (size_t k = j + 1; k < pieces_.size(); k++)
-					pieces_[j]->collide(*pieces_[k]);
+		{
+			phase_timer timer(timings_.solve, profile_section::SOLVE);
+			substep_fast_pieces();
 		}
-	}
 
-	if (!--spawn_tic_) {
-		piece_factory& factory = piece_factory::get_instance();
+		// the pairs found here hold for the whole update: the broad phase
+		// margin covers what pieces move while being solved, and contacts
+		// it misses are picked up by the next update
+
+		{
+			phase_timer timer(timings_.broad_phase, profile_section::BROAD_PHASE);
+			update_broad_phase();
+		}
+
+		// islands never share pieces, so the result doesn't depend on the
+		// number of threads
+
+		{
+			phase_timer timer(timings_.solve, profile_section::SOLVE);
+
+			for (auto& i : solve_times_)
+				i.springs = i.walls = i.collide = 0;
+
+			thread_pool_.parallel_for(
+				islands_.size(),
+				ISLANDS_PER_JOB,
+				[this] (size_t begin, size_t end) {
+					solve_times& times = solve_times_[thread_pool::get_thread_index()];
+
+					for (size_t i = begin; i < end; i++)
+						solve_island(i, times);
+				});
+
+			solve_times total {};
+
+			for (auto& i : solve_times_) {
+				total.springs += i.springs;
+				total.walls += i.walls;
+				total.collide += i.collide;
+			}
 
-		piece_ptr piece = factory.make_piece(rand()%factory.get_num_types());
-		piece->move(vec2(rand()%(width_ - BLOCK_SIZE*MAX_PIECE_COLS), height_));
-		pieces_.push_back(piece);
+			timings_.springs += total.springs;
+			timings_.walls += total.walls;
+			timings_.collide += total.collide;
+
+			profiler& prof = profiler::get_instance();
+			prof.add_duration(profile_section::SPRINGS, total.springs);
+			prof.add_duration(profile_section::WALLS, total.walls);
+			prof.add_duration(profile_section::COLLIDE, total.collide);
+		}
+
+		if (allow_sleeping_ && update_sleep_states() && clear_rows_)
+			clear_full_rows();
+
+		prune_contact_caches();
+	}
+
+	if (playback_) {
+		play_back_events();
+	} else if (!--spawn_tic_) {
+		if (max_pieces_ == 0 || pieces_.size() < max_pieces_)
+			spawn_random_piece();
 
 		spawn_tic_ = SPAWN_INTERVAL;
 	}
+
+	++num_updates_;
+	++timings_.updates;
 }
 
-world::world(int width, int height)
-: impl_(new world_impl(width, height))
+world::world(int width, int height, const world_options& options)
+: impl_(new world_impl(width, height, options))
 { }
 
 world::~world() = default;
 
 void
-world::draw() const
+world::update()
+{
+	impl_->update();
+}
+
+uint32_t
+world::get_num_updates() const
+{
+	return impl_->get_num_updates();
+}
+
+int
+world::get_width() const
+{
+	return impl_->get_width();
+}
+
+int
+world::get_height() const
+{
+	return impl_->get_height();
+}
+
+const container&
+world::get_walls() const
+{
+	return impl_->get_walls();
+}
+
+size_t
+world::get_num_pieces() const
+{
+	return impl_->get_num_pieces();
+}
+
+uint32_t
+world::get_layout() const
+{
+	return impl_->get_layout();
+}
+
+size_t
+world::get_num_slots() const
+{
+	return impl_->get_num_slots();
+}
+
+void
+world::get_topologies(size_t first_slot, std::vector<const piece_topology *>& topologies) const
 {
-	impl_->draw();
+	impl_->get_topologies(first_slot, topologies);
 }
 
 void
-world::update()
+world::publish(world_snapshot& s) const
 {
-	impl_->update();
+	impl_->publish(s);
+}
+
+const world_timings&
+world::get_timings() const
+{
+	return impl_->get_timings();
+}
+
+void
+world::reset_timings()
+{
+	impl_->reset_timings();
 }
@@ -1,18 +1,144 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+
+#include <cstdint>
+
+#include "vec2.h"
+#include "broad_phase.h"
+#include "piece_pattern.h"
+#include "container.h"
 
 class world_impl;
+class replay_log;
+struct piece_topology;
+
+// How hard the solver works. Each update runs passes of springs, walls
+// and collisions over every island of touching pieces until no spring in
+// it is stretched and no contact pushes by more than tolerance, but at
+// least min_iterations and at most the island's budget of them. The
+// budget starts at base_iterations and goes up by contact_iterations for
+// every pair of pieces touching in the island, up to max_iterations. A
+// tolerance of 0 always runs the whole budget.
+
+struct solver_options
+{
+	int min_iterations = 1;
+	int max_iterations = 30;
+	int base_iterations = 10;
+	float contact_iterations = 2;
+	float tolerance = .1f;
+};
+
+struct world_options
+{
+	broad_phase_type broad_phase = broad_phase_type::SPATIAL_HASH;
+	int num_threads = 0; // solver threads, 0 for one per core
+	bool allow_sleeping = true;
+	size_t max_pieces = 0; // stop spawning past this, 0 for no limit
+	uint32_t seed = 1; // picks the piece stream
+	solver_options solver;
+
+	// rows of settled blocks that fill the walls are taken out, and the
+	// pile is emptied when a settled piece sticks out of the top; settled
+	// means asleep, so this needs allow_sleeping
+	bool clear_rows = false;
+
+	// the walls, copied in; a bowl as wide and high as the world if not set
+	const container *walls = nullptr;
+
+	// spawns are appended to record if set; with playback set the world only
+	// spawns what the log says, when it says so
+	replay_log *record = nullptr;
+	const replay_log *playback = nullptr;
+};
+
+// wall clock time spent in each phase of update(), in milliseconds, summed
+// over every update since the last reset
+
+struct world_timings
+{
+	double integrate = 0;
+	double broad_phase = 0;
+	double solve = 0; // springs, walls and collisions
+
+	// the parts of solving islands, summed over solver threads, so with
+	// more than one they can add up to more than solve
+	double springs = 0;
+	double walls = 0;
+	double collide = 0;
+
+	int updates = 0;
+};
+
+// What a renderer needs of the world at one update, copied out so it can be
+// drawn while the world moves on. Pieces are in the same order as in the
+// world.
+
+struct world_snapshot
+{
+	uint32_t update = 0; // get_num_updates() when published
+
+	// world::get_layout() and world::get_num_slots() when published
+	uint32_t layout = 0;
+	size_t num_slots = 0;
+
+	// the topology of every piece, which says how its bodies make up quads;
+	// these never change while the layout stays the same, so publishing
+	// only appends to them
+	std::vector<const piece_topology *> topologies;
+
+	// interleaved x, y of every body in the previous and current state,
+	// each piece's bodies in the order of its topology
+	std::vector<float> prev_xy;
+	std::vector<float> xy;
+
+	size_t get_num_bodies() const
+	{ return xy.size()/2; }
+
+	// interleaved x, y of every body, blended between prev_xy (0) and xy (1)
+	// by alpha
+
+	void get_body_positions(float *out, float alpha) const;
+};
 
 class world
 {
 public:
-	world(int width, int height);
+	world(int width, int height, const world_options& options = world_options());
 	~world();
 
-	void draw() const;
 	void update();
 
+	uint32_t get_num_updates() const;
+
+	int get_width() const;
+	int get_height() const;
+
+	const container& get_walls() const;
+
+	size_t get_num_pieces() const;
+
+	// Pieces live in numbered slots, drawn in slot order. Until get_layout()
+	// changes, pieces are only ever added in new slots after every other,
+	// so the bodies of the pieces already there stay where they are.
+
+	uint32_t get_layout() const;
+	size_t get_num_slots() const;
+
+	// the topologies of pieces in slots from first_slot on
+
+	void get_topologies(size_t first_slot, std::vector<const piece_topology *>& topologies) const;
+
+	// brings s up to the current state; a snapshot published before with
+	// the same layout only gets the topologies of pieces spawned since
+
+	void publish(world_snapshot& s) const;
+
+	const world_timings& get_timings() const;
+	void reset_timings();
+
 private:
 	std::unique_ptr<world_impl> impl_;
 
@@ -0,0 +1,309 @@
+#include <GL/glew.h>
+
+#include <vector>
+#include <initializer_list>
+
+#include <cassert>
+
+#include "texture.h"
+#include "shaders.h"
+#include "piece.h"
+#include "world.h"
+#include "world_renderer.h"
+
+namespace {
+constexpr auto INITIAL_STREAM_VERTICES = 4096;
+
+// bodies a batch can reach with 16 bit indices
+constexpr size_t MAX_BATCH_BODIES = 65536;
+}
+
+static_assert(sizeof(gge::vertex_flat) == 2*sizeof(float), "world writes positions as packed x, y pairs");
+
+world_renderer::world_renderer(const world& w, const char *texture_cache_dir, bool compress_textures, float scale, bool instanced)
+: texture_(new gge::texture)
+, positions_(INITIAL_STREAM_VERTICES)
+, layout_(0)
+, num_pieces_(0)
+, instanced_(instanced && gge::buffer_texture::is_supported())
+, max_texels_(instanced_ ? gge::buffer_texture::get_max_texels() : 0)
+{
+	const auto atlas = piece_factory::get_instance().get_atlas().make_pixmap(texture_cache_dir);
+
+	gge::compressed_format format;
+
+	// drawn smaller than it was made, the atlas is sampled from the level
+	// closest to the size on screen, as deep as its gutter allows
+
+	bool mipmaps = false;
+
+	if (compress_textures && gge::texture::pick_compressed_format(format)) {
+		texture_->load(gge::compress(atlas, format));
+	} else {
+		mipmaps = scale < 1;
+		texture_->load(atlas, mipmaps ? ATLAS_MAX_MIP_LEVEL : 0);
+	}
+
+	texture_->set_wrap_s(GL_CLAMP_TO_EDGE);
+	texture_->set_wrap_t(GL_CLAMP_TO_EDGE);
+
+	texture_->set_mag_filter(GL_LINEAR);
+	texture_->set_min_filter(mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+	for (auto& i : w.get_walls().get_outline())
+		wall_va_.push_back({ i.x, i.y });
+
+	shaders::build(flat_program_, "flat", shaders::FLAT_VERTEX, shaders::FLAT_FRAGMENT);
+	shaders::build(piece_program_, "piece", shaders::PIECE_VERTEX, shaders::PIECE_FRAGMENT);
+
+	if (instanced_) {
+		shaders::build(instanced_program_, "instanced piece", shaders::INSTANCED_PIECE_VERTEX, shaders::INSTANCED_PIECE_FRAGMENT);
+
+		positions_texture_.attach(positions_.get_id(), GL_RG32F);
+		instances_texture_.attach(instances_.get_id(), GL_R32I);
+	}
+}
+
+world_renderer::~world_renderer() = default;
+
+void
+world_renderer::draw(const world_snapshot& s, const gge::mat4& transform, float alpha)
+{
+	draw_walls(transform);
+	draw_pieces(s, transform, alpha);
+
+	gge::program::unuse();
+}
+
+void
+world_renderer::draw_walls(const gge::mat4& transform) const
+{
+	flat_program_.use();
+	flat_program_.set_uniform("transform", transform);
+	flat_program_.set_uniform("color", 1, 1, 1, 1);
+
+	wall_va_.draw(GL_LINE_LOOP);
+}
+
+void
+world_renderer::draw_pieces(const world_snapshot& s, const gge::mat4& transform, float alpha)
+{
+	const size_t num_bodies = s.get_num_bodies();
+
+	if (num_bodies == 0)
+		return;
+
+	// everything but positions only changes with the layout, until then
+	// only new pieces are added
+
+	if (s.layout != layout_) {
+		uvs_.clear();
+		colors_.clear();
+		indices_.clear();
+		batches_.clear();
+		num_pieces_ = 0;
+		layout_ = s.layout;
+	}
+
+	if (num_pieces_ < s.topologies.size()) {
+		append_pieces(s);
+
+		if (instanced_)
+			update_instances(s);
+	}
+
+	assert(uvs_.size() == num_bodies);
+
+	gge::vertex_flat *verts = positions_.map(num_bodies);
+	s.get_body_positions(verts->pos, alpha);
+	positions_.unmap();
+
+	// blending adds, so pieces can go in any order
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	texture_->bind();
+
+	// bodies past what a buffer texture can reach go the indexed way
+
+	if (instanced_ && positions_.get_capacity() <= static_cast<size_t>(max_texels_)) {
+		draw_instanced(transform);
+	} else {
+		piece_program_.use();
+		piece_program_.set_uniform("transform", transform);
+		piece_program_.set_uniform("atlas", 0);
+
+		draw_indexed();
+	}
+
+	glDisable(GL_BLEND);
+}
+
+// every piece shares the same state, so it's a single draw call per batch
+
+void
+world_renderer::draw_indexed() const
+{
+	indices_.bind();
+
+	for (auto& i : batches_) {
+		positions_.enable(i.first_body);
+		uvs_.enable(i.first_body);
+		colors_.enable(i.first_body);
+
+		glDrawElements(GL_TRIANGLES, i.num_indices, GL_UNSIGNED_SHORT, reinterpret_cast<const GLvoid *>(i.first_index*sizeof(GLushort)));
+	}
+
+	indices_.unbind();
+
+	colors_.disable();
+	uvs_.disable();
+	positions_.disable();
+}
+
+// a draw call per mesh, for every piece of its shape
+
+void
+world_renderer::draw_instanced(const gge::mat4& transform) const
+{
+	instanced_program_.use();
+	instanced_program_.set_uniform("transform", transform);
+	instanced_program_.set_uniform("atlas", 0);
+	instanced_program_.set_uniform("positions", 1);
+	instanced_program_.set_uniform("instances", 2);
+	instanced_program_.set_uniform("first_body", static_cast<GLint>(positions_.get_offset()));
+
+	positions_texture_.bind(1);
+	instances_texture_.bind(2);
+
+	mesh_uvs_.enable();
+	mesh_indices_.bind();
+
+	for (auto& i : meshes_) {
+		if (i.instances.empty())
+			continue;
+
+		const piece_topology& t = *i.topology;
+
+		instanced_program_.set_uniform("color", t.color.r, t.color.g, t.color.b, 1);
+		instanced_program_.set_uniform("first_instance", static_cast<GLint>(i.first_instance));
+		instanced_program_.set_uniform("first_vertex", static_cast<GLint>(i.first_vertex));
+
+		glDrawElementsInstanced(GL_TRIANGLES, i.num_indices, GL_UNSIGNED_SHORT, reinterpret_cast<const GLvoid *>(i.first_index*sizeof(GLushort)), i.instances.size());
+	}
+
+	mesh_indices_.unbind();
+	mesh_uvs_.disable();
+}
+
+void
+world_renderer::append_pieces(const world_snapshot& s)
+{
+	std::vector<gge::vertex_uv> uv_verts;
+	std::vector<gge::vertex_color> color_verts;
+	std::vector<GLushort> indices;
+
+	size_t num_bodies = uvs_.size();
+	size_t num_indices = indices_.size();
+
+	for (size_t i = num_pieces_; i < s.topologies.size(); i++) {
+		const piece_topology& t = *s.topologies[i];
+
+		const size_t count = t.rest_positions.size();
+
+		if (batches_.empty() || num_bodies + count - batches_.back().first_body > MAX_BATCH_BODIES)
+			batches_.push_back({ num_bodies, num_indices, 0 });
+
+		batch& b = batches_.back();
+
+		// the same diagonal as gge::detail::quad_indices
+
+		const GLushort base = num_bodies - b.first_body;
+
+		for (auto& q : t.quads) {
+			for (int j : { q.p0, q.p1, q.p3, q.p1, q.p2, q.p3 })
+				indices.push_back(base + j);
+		}
+
+		b.num_indices += 6*t.quads.size();
+		num_indices += 6*t.quads.size();
+
+		for (auto& uv : t.uvs)
+			uv_verts.push_back({ uv.x, uv.y });
+
+		color_verts.insert(color_verts.end(), count, { t.color.r, t.color.g, t.color.b });
+
+		num_bodies += count;
+	}
+
+	uvs_.append(uv_verts.begin(), uv_verts.end());
+	colors_.append(color_verts.begin(), color_verts.end());
+	indices_.append(indices.begin(), indices.end());
+
+	num_pieces_ = s.topologies.size();
+}
+
+// the mesh for topology, made the first time it's drawn
+
+world_renderer::mesh&
+world_renderer::get_mesh(const piece_topology& topology)
+{
+	const auto it = mesh_indices_by_topology_.find(&topology);
+
+	if (it != mesh_indices_by_topology_.end())
+		return meshes_[it->second];
+
+	const size_t first_vertex = mesh_uvs_.size();
+
+	assert(first_vertex + topology.rest_positions.size() <= MAX_BATCH_BODIES);
+
+	std::vector<gge::vertex_uv> uv_verts;
+
+	for (auto& uv : topology.uvs)
+		uv_verts.push_back({ uv.x, uv.y });
+
+	// the same diagonal as the indexed path
+
+	std::vector<GLushort> indices;
+
+	for (auto& q : topology.quads) {
+		for (int j : { q.p0, q.p1, q.p3, q.p1, q.p2, q.p3 })
+			indices.push_back(first_vertex + j);
+	}
+
+	meshes_.push_back({ &topology, first_vertex, mesh_indices_.size(), indices.size(), 0, {} });
+	mesh_indices_by_topology_[&topology] = meshes_.size() - 1;
+
+	mesh_uvs_.append(uv_verts.begin(), uv_verts.end());
+	mesh_indices_.append(indices.begin(), indices.end());
+
+	return meshes_.back();
+}
+
+// every piece in s as an instance of its mesh, starting at its first body;
+// pieces only come and go with new snapshots, so this is redone then
+
+void
+world_renderer::update_instances(const world_snapshot& s)
+{
+	for (auto& i : meshes_)
+		i.instances.clear();
+
+	GLint first_body = 0;
+
+	for (auto t : s.topologies) {
+		get_mesh(*t).instances.push_back(first_body);
+		first_body += t->rest_positions.size();
+	}
+
+	std::vector<GLint> instances;
+
+	for (auto& i : meshes_) {
+		i.first_instance = instances.size();
+		instances.insert(instances.end(), i.instances.begin(), i.instances.end());
+	}
+
+	instances_.clear();
+	instances_.append(instances.begin(), instances.end());
+}
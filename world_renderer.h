@@ -0,0 +1,111 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include <cstdint>
+
+#include "vertex_array.h"
+#include "vertex_buffer.h"
+#include "buffer_texture.h"
+#include "program.h"
+#include "mat4.h"
+
+namespace gge {
+class texture;
+}
+
+class world;
+struct world_snapshot;
+struct piece_topology;
+
+// GL resources needed to draw a world: the piece atlas texture, the wall
+// outline and vertex buffers for the pieces. The world itself never
+// touches GL, so it can be stepped without a context, and the renderer
+// only reads the world's snapshots, so it can be stepped on another thread.
+
+class world_renderer
+{
+public:
+	// generated textures are cached in texture_cache_dir if set, and block
+	// compressed if compress_textures is set and the GL supports a format
+	// we can encode. scale is the pixels per world unit pieces come out at;
+	// below 1 the atlas is mipmapped, unless it's compressed. With
+	// instanced set, and if the GL has buffer textures, pieces of the same
+	// shape are drawn as instances of one mesh.
+
+	world_renderer(const world& w, const char *texture_cache_dir = nullptr, bool compress_textures = false, float scale = 1, bool instanced = false);
+	~world_renderer();
+
+	// transform takes world coordinates to clip space; alpha blends between
+	// the previous (0) and current (1) state of s, which must be a snapshot
+	// of the world passed in
+
+	void draw(const world_snapshot& s, const gge::mat4& transform, float alpha = 1);
+
+private:
+	// a run of triangles whose bodies all lie within 16 bit indices of
+	// first_body
+	struct batch
+	{
+		size_t first_body;
+		size_t first_index;
+		size_t num_indices;
+	};
+
+	// the bodies of one topology in the mesh buffers, and the first body of
+	// every piece it has in the current layout
+	struct mesh
+	{
+		const piece_topology *topology;
+		size_t first_vertex;
+		size_t first_index;
+		size_t num_indices;
+		size_t first_instance; // in instances_
+		std::vector<GLint> instances;
+	};
+
+	void draw_walls(const gge::mat4& transform) const;
+	void draw_pieces(const world_snapshot& s, const gge::mat4& transform, float alpha);
+	void draw_indexed() const;
+	void draw_instanced(const gge::mat4& transform) const;
+	void append_pieces(const world_snapshot& s);
+	void update_instances(const world_snapshot& s);
+	mesh& get_mesh(const piece_topology& topology);
+
+	std::unique_ptr<gge::texture> texture_;
+	gge::vertex_array_flat wall_va_;
+
+	gge::program flat_program_;
+	gge::program piece_program_;
+
+	// body i takes its position from the frame's region of positions_ and
+	// its texture coordinates and color from uvs_ and colors_, all in piece
+	// order; indices_ makes the bodies of each quad into two triangles, with
+	// each batch's indices counted from its first body. Only positions
+	// change from frame to frame.
+	gge::stream_vertex_buffer<gge::vertex_flat> positions_;
+	gge::static_vertex_buffer<gge::vertex_uv> uvs_;
+	gge::static_vertex_buffer<gge::vertex_color> colors_;
+	gge::static_index_buffer indices_;
+	std::vector<batch> batches_;
+	uint32_t layout_; // of the snapshot the static buffers came from
+	size_t num_pieces_; // in the static buffers
+
+	// instanced drawing: a mesh for every topology seen so far, which never
+	// changes, and the instances of each in the current layout
+	bool instanced_;
+	GLint max_texels_;
+	gge::program instanced_program_;
+	gge::static_vertex_buffer<gge::vertex_uv> mesh_uvs_;
+	gge::static_index_buffer mesh_indices_;
+	std::vector<mesh> meshes_;
+	std::unordered_map<const piece_topology *, size_t> mesh_indices_by_topology_;
+	gge::static_texel_buffer<GLint> instances_;
+	gge::buffer_texture positions_texture_;
+	gge::buffer_texture instances_texture_;
+
+	world_renderer(const world_renderer&) = delete;
+	world_renderer& operator=(const world_renderer&) = delete;
+};